@@ -0,0 +1,117 @@
+#pragma once
+
+#include "FileSystemApi.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace impl
+{
+	class TaskPool;
+}
+
+namespace fs
+{
+	struct ContentHashStatistics
+	{
+		size_t filesHashed{ 0 };
+		// Files whose hash came from the cache without reading them
+		size_t cacheHits{ 0 };
+		uint64_t bytesHashed{ 0 };
+	};
+
+	// Hashes the contents of files (XXH64, the same values the reference implementation produces)
+	// on a pool of worker threads.
+	//
+	// Large files are memory mapped, small ones are read into a buffer every worker owns. The largest files
+	// are started first, small ones are handed out in batches, so that a few huge files don't end up last on one worker.
+	//
+	// Every hash is remembered together with the size, last write time and file id (the inode, 0 where there's no such thing)
+	// the file had when it was read. A file that still has all three is not read again. The cache can be saved and loaded,
+	// so that unchanged files aren't read after a restart either.
+	class ContentHasher
+	{
+	public:
+
+		FS_API ContentHasher();
+		FS_API ~ContentHasher();
+
+		// Number of worker threads, 0 (default) means "use as many threads as there are hardware threads"
+		FS_API void SetThreadCount(size_t threadCount);
+		FS_API size_t GetThreadCount() const;
+
+		// 'hashes[i]' and 'errors[i]' belong to 'absPaths[i]'. Files that couldn't be read have a hash of 0.
+		FS_API ContentHashStatistics HashFiles(
+			const std::vector<std::filesystem::path>& absPaths,
+			std::vector<uint64_t>& hashes,
+			std::vector<std::error_code>& errors);
+		// Same as above, but only the first 'prefixSize' bytes of every file are read and nothing is cached.
+		// Files that aren't longer than that get the same hash as above.
+		FS_API void HashFilePrefixes(
+			const std::vector<std::filesystem::path>& absPaths,
+			size_t prefixSize,
+			std::vector<uint64_t>& hashes,
+			std::vector<std::error_code>& errors);
+
+		// Cache
+		//
+		// Returns false if the cache couldn't be written
+		FS_API bool SaveCache(const std::filesystem::path& cachePath) const;
+		// Adds the entries of a saved cache to this one. Returns false without touching anything
+		// if the file is missing, corrupted or was written by a build for a different platform.
+		FS_API bool LoadCache(const std::filesystem::path& cachePath);
+		FS_API void ClearCache();
+		FS_API size_t GetCacheSize() const;
+
+		// XXH64 of a block of memory
+		FS_API static uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+	private:
+
+		struct FileIdentity
+		{
+			uint64_t size{ 0 };
+			// 'file_time_type' ticks
+			int64_t lastWriteTime{ 0 };
+			uint64_t fileId{ 0 };
+
+			bool operator==(const FileIdentity& other) const;
+		};
+
+		struct CacheEntry
+		{
+			FileIdentity identity;
+			uint64_t hash{ 0 };
+		};
+
+		struct Job
+		{
+			size_t index;
+			FileIdentity identity;
+		};
+
+		static FileIdentity QueryIdentity(const std::filesystem::path& absPath, std::error_code& error);
+		static uint64_t HashFile(
+			const std::filesystem::path& absPath,
+			std::vector<std::byte>& buffer,
+			uint64_t& bytesRead,
+			std::error_code& error);
+		// Hashes as many bytes as 'buffer' can hold
+		static uint64_t HashFilePrefix(
+			const std::filesystem::path& absPath,
+			std::vector<std::byte>& buffer,
+			std::error_code& error);
+
+		// Keyed by the generic form of the absolute path
+		std::unordered_map<std::string, CacheEntry> cache;
+
+		std::unique_ptr<impl::TaskPool> taskPool;
+		size_t threadCount{ 0 };
+	};
+}
\ No newline at end of file
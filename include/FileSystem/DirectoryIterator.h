@@ -0,0 +1,120 @@
+#pragma once
+
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace fs
+{
+	enum class TraversalOrder
+	{
+		// A directory comes before its entries
+		PRE_ORDER,
+		// A directory comes after its entries
+		POST_ORDER
+	};
+
+	// Walks everything under a directory (the directory itself isn't visited) in place, with one explicit stack
+	// instead of building a vector at every level. Every directory yields its files first, then its subdirectories,
+	// so the pre-order is the same one 'Directory::GetDirEntriesRecursive' uses.
+	//
+	// Entries are handed out by reference, ownership is only shared when 'GetEntry' is called.
+	// Stop whenever you want, nothing is left behind. Changing the tree while walking it invalidates the iterator.
+	// Constructing an iterator isn't free, so keep the end iterator outside of the loop condition.
+	class RecursiveDirectoryIterator
+	{
+	public:
+
+		// Entries it returns false for are stepped over, but their subtrees are still walked
+		using Filter = std::function<bool(const DirectoryEntry& entry)>;
+
+		using iterator_category = std::input_iterator_tag;
+		using value_type = DirectoryEntry;
+		using difference_type = std::ptrdiff_t;
+		using pointer = DirectoryEntry*;
+		using reference = DirectoryEntry&;
+
+		// The end iterator
+		FS_API RecursiveDirectoryIterator();
+		// With 'expand' lazily expanded directories are expanded on the way (like the recursive getters of 'Directory' do),
+		// otherwise only what's already loaded is visited
+		FS_API explicit RecursiveDirectoryIterator(
+			const Directory& dir,
+			TraversalOrder order = TraversalOrder::PRE_ORDER,
+			bool expand = true,
+			Filter filter = Filter{});
+
+		FS_API DirectoryEntry& operator*() const;
+		FS_API DirectoryEntry* operator->() const;
+		FS_API RecursiveDirectoryIterator& operator++();
+
+		FS_API bool operator==(const RecursiveDirectoryIterator& other) const;
+		FS_API bool operator!=(const RecursiveDirectoryIterator& other) const;
+
+		// Only valid for the matching type of the current entry
+		FS_API const std::shared_ptr<File>& GetFile() const;
+		FS_API const std::shared_ptr<Directory>& GetDirectory() const;
+		FS_API std::shared_ptr<DirectoryEntry> GetEntry() const;
+
+		// 1 for the entries of the directory the walk started from
+		FS_API size_t GetDepth() const;
+
+		// Pre-order only: the entries of the current directory are left out.
+		// Its expansion is left out as well, a directory is only entered when the iterator moves past it.
+		FS_API void SkipSubtree();
+
+	private:
+
+		struct Level
+		{
+			const Directory* dir;
+			// Files first, then directories
+			size_t nextIndex;
+			// Null for the directory the walk started from
+			const std::shared_ptr<Directory>* dirEntry;
+		};
+
+		void PushLevel(const Directory& dir, const std::shared_ptr<Directory>* dirEntry);
+		void Advance();
+		bool Accept(const DirectoryEntry& entry) const;
+
+		std::vector<Level> stack;
+
+		const std::shared_ptr<File>* currentFile{ nullptr };
+		const std::shared_ptr<Directory>* currentDir{ nullptr };
+		size_t currentDepth{ 0 };
+		// Pre-order: the current directory is entered on the next increment, unless it's skipped
+		bool enterCurrentDir{ false };
+
+		TraversalOrder order{ TraversalOrder::PRE_ORDER };
+		bool expand{ true };
+		Filter filter;
+	};
+
+	// Makes the iterator above usable in range-based for loops
+	class RecursiveDirectoryRange
+	{
+	public:
+
+		FS_API explicit RecursiveDirectoryRange(
+			const Directory& dir,
+			TraversalOrder order = TraversalOrder::PRE_ORDER,
+			bool expand = true,
+			RecursiveDirectoryIterator::Filter filter = RecursiveDirectoryIterator::Filter{});
+
+		FS_API RecursiveDirectoryIterator begin() const;
+		FS_API RecursiveDirectoryIterator end() const;
+
+	private:
+
+		const Directory& dir;
+		TraversalOrder order;
+		bool expand;
+		RecursiveDirectoryIterator::Filter filter;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace fs
+{
+	struct ScannedEntry
+	{
+		std::string name;
+		DirectoryEntryType type{ DirectoryEntryType::UNDEFINED };
+		std::filesystem::file_time_type lastWriteTime{};
+		// Files only
+		uint64_t size{ 0 };
+	};
+
+	struct EntryStatus
+	{
+		std::filesystem::file_time_type lastWriteTime{};
+		// Files only
+		uint64_t size{ 0 };
+	};
+
+	enum class DirectoryScannerBackend
+	{
+		// 'std::filesystem::directory_iterator' based scanning, available everywhere
+		STANDARD,
+		// OS specific scanning if there's an implementation for the current platform,
+		// 'STANDARD' otherwise
+		NATIVE
+	};
+
+	class DirectoryScanner
+	{
+	public:
+
+		FS_API void SetBackend(DirectoryScannerBackend backend);
+		FS_API DirectoryScannerBackend GetBackend() const;
+
+		// Lists regular files and directories (symbolic links are followed) inside of 'dirAbsPath'
+		// together with their last write time and size. Entries come in the order the OS lists them.
+		// Throws 'std::filesystem::filesystem_error' if the directory can't be opened.
+		//
+		// This function doesn't change the state of the object,
+		// so it's safe to call it from multiple threads at once.
+		FS_API void ScanDirectory(
+			const std::filesystem::path& dirAbsPath,
+			std::vector<ScannedEntry>& entries) const;
+
+		// Returns a default constructed 'file_time_type' and sets 'error' if the entry can't be queried
+		FS_API std::filesystem::file_time_type GetLastWriteTime(
+			const std::filesystem::path& absPath,
+			std::error_code& error) const;
+		// Same as above, with the size of a file queried by the same call.
+		// Returns a default constructed 'EntryStatus' and sets 'error' if the entry can't be queried.
+		FS_API EntryStatus GetStatus(
+			const std::filesystem::path& absPath,
+			std::error_code& error) const;
+
+	private:
+
+		bool UseNativeBackend() const;
+
+		DirectoryScannerBackend backend{ DirectoryScannerBackend::NATIVE };
+	};
+}
\ No newline at end of file
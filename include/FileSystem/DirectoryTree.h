@@ -1,12 +1,25 @@
 #pragma once
 
+#include "ContentHasher.h"
+#include "DirectoryScanner.h"
 #include "FileSystemCommon.h"
+#include "GlobQuery.h"
+#include "StatusRefresher.h"
+#include "TreeVersion.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <vector>
 
+namespace impl
+{
+	class TaskPool;
+}
+
 namespace fs
 {
 	class DirectoryTreeProcessor
@@ -17,6 +30,27 @@ namespace fs
 		virtual void ProcessDirectoryTree(std::shared_ptr<Directory> root) = 0;
 	};
 
+	// Processes the tree on several threads at once (see 'DirectoryTree::ProcessDirectoryTreeParallel').
+	//
+	// 'ProcessDirectory' and 'ProcessFile' are called concurrently, 'workerIndex' tells which worker is calling.
+	// Keep partial results in per-worker slots (sized in 'BeginProcessing'), so that workers never wait for each other,
+	// and combine them in 'EndProcessing'. Entries are only to be read: use the paths passed in instead of 'GetPath'
+	// (which updates a cache) and the 'GetLoaded...' functions of directories (the other getters may expand them).
+	// Don't keep any references to the entries after 'EndProcessing'.
+	class ParallelDirectoryTreeProcessor
+	{
+	public:
+		// Called on the calling thread before anything else, workers are indexed from 0 to 'workerCount' - 1
+		virtual void BeginProcessing(size_t workerCount) = 0;
+
+		// Every loaded directory (the root included) and file. Do nothing by default.
+		FS_API virtual void ProcessDirectory(const Directory& dir, const std::filesystem::path& dirPath, size_t workerIndex);
+		FS_API virtual void ProcessFile(const File& file, const std::filesystem::path& filePath, size_t workerIndex);
+
+		// The reduction step, called on the calling thread once all the entries have been processed
+		virtual void EndProcessing() = 0;
+	};
+
 	class DirectoryTreeEventListener
 	{
 	public:
@@ -31,19 +65,190 @@ namespace fs
 
 		virtual void OnFileModified(std::shared_ptr<File> file) = 0;
 		virtual void OnDirectoryModified(std::shared_ptr<Directory> dir) = 0;
+
+		// Batched notifications
+		//
+		// Operations that touch a whole subtree (building the tree, expanding, adding or removing
+		// a directory, loading a snapshot) report all of its entries in one call,
+		// in the same order the per-entry callbacks would get them. By default every entry is forwarded
+		// to the matching per-entry callback above, override these to handle the whole batch at once.
+		// Single file operations and modifications always use the per-entry callbacks.
+		FS_API virtual void OnEntriesAdded(const std::vector<std::shared_ptr<DirectoryEntry>>& entries);
+		FS_API virtual void OnEntriesRemoved(const std::vector<std::shared_ptr<DirectoryEntry>>& entries);
+		// Entries paired with their old paths
+		FS_API virtual void OnEntriesPathChanged(
+			const std::vector<std::pair<std::shared_ptr<DirectoryEntry>, std::filesystem::path>>& entries);
+
+		// A directory was moved or renamed, which changes the path of everything under it as well.
+		// By default the directory and all of its loaded entries are passed to 'OnEntriesPathChanged'
+		// (see 'GetSubtreeOldPaths'), which costs as much as the size of the subtree. Override this to only deal
+		// with the directory itself, the new paths of its entries can be derived from 'GetPath' whenever they're needed.
+		// The tree's own indices do, so a move only costs as much as the depth of the directory.
+		FS_API virtual void OnSubtreePathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath);
+
+	protected:
+
+		// 'dir' and all of its loaded entries in pre-order, paired with the paths they had under 'oldPath'
+		FS_API static std::vector<std::pair<std::shared_ptr<DirectoryEntry>, std::filesystem::path>> GetSubtreeOldPaths(
+			std::shared_ptr<Directory> dir,
+			const std::filesystem::path& oldPath);
 	};
 
-	class DirectoryTree
+	class NameSearchIndex;
+	class DuplicateFinder;
+
+	struct RescanStatistics
+	{
+		size_t directoriesListed{ 0 };
+		size_t entriesStated{ 0 };
+	};
+
+	class DirectoryTree : private DirectoryExpander
 	{
 	public:
 
+		FS_API DirectoryTree();
+		FS_API ~DirectoryTree();
+
 		FS_API void AddDirTreeEventListener(DirectoryTreeEventListener* listener);
 		FS_API void RemoveDirTreeEventListener(DirectoryTreeEventListener* listener);
 
 		FS_API void BuildRootTree(const std::filesystem::path& rootDirAbsPath);
 
+		// Number of threads 'BuildRootTree' and 'AddNewDirectory' use to scan the disk.
+		// 1 (default) builds the tree on the calling thread.
+		// 0 means "use as many threads as there are hardware threads".
+		// Listeners are notified on the calling thread in the same order regardless of this value.
+		FS_API void SetBuildThreadCount(size_t threadCount);
+		FS_API size_t GetBuildThreadCount() const;
+
+		// 'NATIVE' (default) uses the OS specific scanner where there's one
+		FS_API void SetScannerBackend(DirectoryScannerBackend backend);
+		FS_API DirectoryScannerBackend GetScannerBackend() const;
+
+		// Lazy expansion
+		//
+		// When enabled (it's disabled by default) 'BuildRootTree', 'AddNewDirectory' and 'LoadSnapshot' create directories
+		// unexpanded, their entries are listed the first time a 'Directory' getter or 'GetDirectory' touches them,
+		// so memory and startup time depend on what's actually visited instead of the size of the tree.
+		// Listeners are notified about the entries of a directory when it's expanded.
+		// Changes inside directories that haven't been expanded yet are ignored, the next listing picks them up.
+		// Must be set before the tree is built.
+		FS_API void SetLazyExpansion(bool enabled);
+		FS_API bool IsLazyExpansionEnabled() const;
+		// Directories that couldn't be listed when they were expanded since the last call. They stay unexpanded,
+		// so they're listed again (and reported again if that fails too) the next time they're touched.
+		FS_API std::vector<std::pair<std::filesystem::path, std::error_code>> TakeExpansionErrors();
+
+		// Lists the subdirectories of a directory in the background as soon as it's expanded,
+		// so that expanding them later doesn't have to wait for the disk. Only used together with lazy expansion.
+		FS_API void SetLazyPrefetch(bool enabled);
+		FS_API bool IsLazyPrefetchEnabled() const;
+
+		// Concurrent readers
+		//
+		// When versioning is enabled every change made through this class publishes a new 'TreeVersion':
+		// an immutable copy of the tree that shares unchanged subtrees with the previous version.
+		// Any number of threads can call 'GetVersion' and read the version they got without any locking
+		// while this tree keeps changing. The tree itself (including 'Directory' and 'File' objects) is still
+		// only used by one thread at a time.
+		FS_API void SetVersioning(bool enabled);
+		FS_API bool IsVersioningEnabled() const;
+
+		// Can be called from any thread. Returns a default constructed 'shared_ptr' if versioning is disabled.
+		FS_API std::shared_ptr<const TreeVersion> GetVersion() const;
+
+		// Changes are published automatically, except for the ones made directly through
+		// 'Directory' objects (sorting types for example). This publishes a version copied from scratch.
+		FS_API void PublishVersion();
+
+		// Extension index
+		//
+		// When enabled every loaded file is indexed by its extension (the one 'File::GetFileExtension' returns, ".png"),
+		// and the index follows every change made through this class. Looking files up costs as much as the result,
+		// counting them costs nothing. Extensions are compared as they are, ".PNG" isn't ".png".
+		FS_API void SetExtensionIndexing(bool enabled);
+		FS_API bool IsExtensionIndexingEnabled() const;
+
+		// Loaded files with this extension, in no particular order ("" for files without one).
+		// Empty if indexing is disabled. The reference is only valid until the tree changes.
+		FS_API const std::vector<std::shared_ptr<File>>& GetFilesWithExtension(const std::string& extension) const;
+		FS_API size_t GetFileCountWithExtension(const std::string& extension) const;
+
+		// Name search
+		//
+		// When enabled every loaded file and directory is indexed by its name (see 'NameSearchIndex'),
+		// and the index follows every change made through this class
+		FS_API void SetNameSearchIndexing(bool enabled);
+		FS_API bool IsNameSearchIndexingEnabled() const;
+		// Null if indexing is disabled
+		FS_API const NameSearchIndex* GetNameSearchIndex() const;
+
+		// Content hashing
+		//
+		// When enabled the contents of every file passed to 'ProcessModifiedFile(s)' are hashed (see 'ContentHasher')
+		// and listeners are only notified about files whose contents actually changed: touching a file or writing
+		// the same bytes again isn't a modification, a different version restored with the old timestamp is
+		// (unless it was written in place, the hasher's cache trusts files with the same size, last write time and inode).
+		// Files that haven't been hashed yet fall back to comparing last write times once and are hashed from then on.
+		// Disabling it drops the hashes of all files.
+		FS_API void SetContentHashing(bool enabled);
+		FS_API bool IsContentHashingEnabled() const;
+		// Null if hashing is disabled. Threads and the hash cache are set up through it.
+		FS_API ContentHasher* GetContentHasher();
+		// Hashes every loaded file that doesn't have a hash yet. Returns the files that couldn't be read.
+		// Does nothing if hashing is disabled.
+		FS_API std::vector<std::pair<std::filesystem::path, std::error_code>> HashFileContents();
+
+		// Duplicates
+		//
+		// When enabled every loaded file is tracked by a 'DuplicateFinder' that follows every change made through this class.
+		// Nothing is read until 'UpdateDuplicates' is called, which only reads what changed since the last call.
+		FS_API void SetDuplicateDetection(bool enabled);
+		FS_API bool IsDuplicateDetectionEnabled() const;
+		// Null if detection is disabled
+		FS_API DuplicateFinder* GetDuplicateFinder();
+		// Returns the files that couldn't be read. Does nothing if detection is disabled.
+		FS_API std::vector<std::pair<std::filesystem::path, std::error_code>> UpdateDuplicates();
+
+		// Sorting
+		//
+		// The sorting type every directory of the tree gets, including the ones created later by building, expanding
+		// or adding directories (directories loaded from a snapshot keep the type they were saved with).
+		// Setting it sorts every loaded directory again on 'threadCount' threads (0 means "as many as there are
+		// hardware threads"): directories are spread over the threads, very large ones are split into chunks
+		// that are sorted separately and then merged. Doesn't notify listeners, a new version is published.
+		FS_API void SetSortingType(DirEntrySortType sortType, size_t threadCount = 0);
+		FS_API DirEntrySortType GetSortingType() const;
+
 		FS_API void ClearTree();
 
+		// Snapshots
+		//
+		// A snapshot is a compact binary image of the tree (relative paths, entry types, last write times, file sizes
+		// and sorting types) that's loaded with a single memory mapping instead of scanning the disk.
+
+		// Returns false if the snapshot couldn't be written.
+		// Directories that haven't been expanded yet are saved as such and stay unexpanded after loading
+		// (or are built right away if the loading tree doesn't use lazy expansion).
+		FS_API bool SaveSnapshot(const std::filesystem::path& snapshotPath) const;
+		// Builds the tree from a snapshot and then reconciles it with the disk: only directories
+		// whose last write time changed are listed again, everything else is just stat'ed.
+		// Listeners are notified about every loaded entry (directories before their contents),
+		// then about the differences found during reconciliation.
+		// Returns false without touching the tree if the snapshot is missing,
+		// corrupted or was written for a different root directory.
+		FS_API bool LoadSnapshot(const std::filesystem::path& snapshotPath, const std::filesystem::path& rootDirAbsPath);
+
+		// Brings the tree back in sync with the disk after changes that weren't reported (watcher outages,
+		// resume from sleep) without rebuilding it. Only directories whose last write time moved are listed
+		// again, unchanged subtrees are just stat'ed. Listeners are only notified about the differences:
+		// added and removed entries and entries whose last write time changed.
+		// Modified files lose their content hashes, 'HashFileContents' hashes them again.
+		// The second overload only rescans the subtree of an existing directory.
+		FS_API RescanStatistics Rescan();
+		FS_API RescanStatistics Rescan(const std::filesystem::path& dirPath);
+
 		FS_API void AddNewFile(const std::filesystem::path& filePath);
 		FS_API void AddNewDirectory(const std::filesystem::path& dirPath);
 
@@ -56,6 +261,16 @@ namespace fs
 		FS_API void ProcessModifiedFile(const std::filesystem::path& oldPath);
 		FS_API void ProcessModifiedDirectory(const std::filesystem::path& oldPath);
 
+		// Batched versions of the two functions above for bulk changes (a branch switch for example).
+		// Status of all the entries is refreshed at once through 'StatusRefresher'.
+		// Paths that aren't in the tree are skipped. Returns the entries that couldn't be queried.
+		FS_API std::vector<std::pair<std::filesystem::path, std::error_code>> ProcessModifiedFiles(
+			const std::vector<std::filesystem::path>& oldPaths);
+		FS_API std::vector<std::pair<std::filesystem::path, std::error_code>> ProcessModifiedDirectories(
+			const std::vector<std::filesystem::path>& oldPaths);
+		// Files 'ProcessModifiedFile' couldn't query or hash since the last call, the batched version returns them instead
+		FS_API std::vector<std::pair<std::filesystem::path, std::error_code>> TakeModificationErrors();
+
 		FS_API void RenameFile(const std::filesystem::path& oldPath, const std::filesystem::path& newPath);
 		FS_API void RenameDirectory(const std::filesystem::path& oldPath, const std::filesystem::path& newPath);
 
@@ -64,13 +279,29 @@ namespace fs
 		// So many things that could potentially break our protection of the data that the mutex provides us with.
 		FS_API void ProcessDirectoryTree(DirectoryTreeProcessor* processor);
 
-		// Return a default constructed 'std::shared_ptr<Directory>' instance if the directory doesn't exist
+		// Runs 'processor' over every loaded entry of the tree on 'threadCount' threads
+		// (0 means "as many as there are hardware threads") and returns once it's done.
+		// Work is split by directories, the files of large directories are split into chunks as well.
+		// The tree can't change in the meantime, the thread that owns it is waiting in here.
+		// If a callback throws, the first exception is rethrown here and 'EndProcessing' isn't called.
+		FS_API void ProcessDirectoryTreeParallel(ParallelDirectoryTreeProcessor* processor, size_t threadCount = 0);
+
+		// Return a default constructed 'std::shared_ptr<Directory>' instance if the directory doesn't exist.
+		// With lazy expansion the directories on the way to 'dirPath' are expanded.
 		FS_API std::shared_ptr<Directory> GetDirectory(const std::filesystem::path& dirPath) const;
 
 		FS_API std::shared_ptr<Directory> GetRootDirectory() const;
 
+		// Entries whose paths match 'query', streamed while the tree is walked (see 'GlobQueryIterator').
+		// With lazy expansion the directories the walk enters are expanded.
+		FS_API GlobQueryRange Query(GlobQuery query) const;
+
 	private:
 
+		void NotifyEntriesAdded(const Directory::DirectoryEntries& entries);
+		void NotifyEntriesRemoved(const Directory::DirectoryEntries& entries);
+		void NotifySubtreePathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath);
+
 		void NotifyDirectoryAdded(std::shared_ptr<Directory> dir);
 		void NotifyDirectoryRemoved(std::shared_ptr<Directory> dir);
 		void NotifyDirectoryPathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath);
@@ -82,9 +313,90 @@ namespace fs
 		void NotifyFileModified(std::shared_ptr<File> file);
 
 		std::shared_ptr<File> CreateFile(const std::filesystem::path& relPath) const;
+		std::shared_ptr<File> CreateFile(
+			const std::filesystem::path& relPath,
+			std::filesystem::file_time_type lastWriteTime,
+			uint64_t size) const;
 		std::shared_ptr<Directory> CreateDirectory(const std::filesystem::path& relPath) const;
+		std::shared_ptr<Directory> CreateDirectory(
+			const std::filesystem::path& relPath,
+			std::filesystem::file_time_type lastWriteTime) const;
+
+		// Created entries are appended to 'addedEntries' in the order listeners are notified about them
+		std::shared_ptr<Directory> BuildTree(
+			const std::filesystem::path& dirPath,
+			Directory::DirectoryEntries& addedEntries);
+		std::shared_ptr<Directory> BuildTree(
+			const std::filesystem::path& dirPath,
+			std::filesystem::file_time_type lastWriteTime,
+			Directory::DirectoryEntries& addedEntries);
 
-		std::shared_ptr<Directory> BuildTree(const std::filesystem::path& dirPath);
+		// Lazy expansion
+
+		bool ExpandDirectory(Directory& dir) override;
+
+		std::shared_ptr<Directory> CreateLazyDirectory(
+			const std::filesystem::path& relPath,
+			std::filesystem::file_time_type lastWriteTime);
+
+		// Returns a directory only if it's loaded and expanded. Changes inside of any other directory
+		// are picked up when it's listed, so its prefetched listing (if there's one) is dropped.
+		std::shared_ptr<Directory> GetExpandedDirectory(const std::filesystem::path& dirPath);
+		// Walks the path down from the root through the name indices of the directories on the way.
+		// Never expands anything, unlike 'GetDirectory'
+		std::shared_ptr<Directory> FindDirectory(const std::filesystem::path& dirPath) const;
+
+		void PrefetchListings(const std::vector<std::shared_ptr<Directory>>& dirs);
+		bool TakePrefetchedListing(const std::filesystem::path& dirPath, std::vector<ScannedEntry>& entries);
+		void InvalidatePrefetchedListing(const std::filesystem::path& dirPath);
+		// Drops the listings of 'dirPath' and of every directory under it
+		void InvalidatePrefetchedListings(const std::filesystem::path& dirPath);
+
+		// Versioning
+
+		class VersionTracker;
+
+		// Every public function that changes the tree (and every lazy expansion) opens one,
+		// a new version is published when the outermost one is closed
+		class UpdateScope
+		{
+		public:
+
+			UpdateScope(DirectoryTree& tree);
+			~UpdateScope();
+
+		private:
+
+			DirectoryTree& tree;
+			int uncaughtExceptions;
+		};
+
+		void PublishChanges();
+
+		// Extension index
+
+		class ExtensionIndex;
+
+		// Parallel build
+
+		struct ScannedDirectory;
+
+		struct ScannedChild
+		{
+			std::shared_ptr<File> file;
+			std::unique_ptr<ScannedDirectory> dir;
+		};
+		struct ScannedDirectory
+		{
+			std::shared_ptr<Directory> dir;
+			std::vector<ScannedChild> entries;
+		};
+
+		std::shared_ptr<Directory> BuildTreeParallel(
+			const std::filesystem::path& dirPath,
+			Directory::DirectoryEntries& addedEntries);
+		void ScanSubtree(impl::TaskPool& pool, ScannedDirectory* scannedDir) const;
+		void MergeScannedDirectory(ScannedDirectory* scannedDir, Directory::DirectoryEntries& addedEntries);
 
 		// Change 'old path' to 'new path' links
 		/*
@@ -94,20 +406,88 @@ namespace fs
 			std::shared_ptr<Directory> relPathDir);
 		*/
 
-		using EntityPathPairs = std::vector<std::pair<std::shared_ptr<DirectoryEntry>, std::filesystem::path>>;
+		// Forgets the whole tree along with everything derived from it (indices, versions, prefetched listings)
+		// without notifying listeners, before a new one is built or loaded
+		void ResetTree();
 
-		EntityPathPairs ConstructDirEntityPathPairs(std::shared_ptr<Directory> dir);
-		void ProcessPathChanges(const EntityPathPairs& oldPathPairs);
+		// Snapshots
 
-		std::unordered_map<
-			std::filesystem::path,
-			std::shared_ptr<Directory>> directories;
+		bool BuildTreeFromSnapshot(
+			const std::byte* snapshotData,
+			size_t snapshotSize,
+			const std::filesystem::path& rootDirRelPath,
+			std::vector<std::shared_ptr<Directory>>& unexpandedDirs);
+
+		void ReconcileDirectories(
+			std::vector<std::pair<std::shared_ptr<Directory>, bool>> dirsToVisit,
+			RescanStatistics& statistics);
+		void ReconcileDirectoryEntries(
+			std::shared_ptr<Directory> dir,
+			std::vector<std::pair<std::shared_ptr<Directory>, bool>>& subdirsToVisit,
+			RescanStatistics& statistics);
+
+		void ProcessSubtreePathChange(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath);
+
+		// Sorting
+
+		// Sorts the files of one directory on all of the workers of 'pool', which must be idle
+		void SortFilesParallel(Directory& dir, impl::TaskPool& pool);
+
+		// Content hashing
+
+		// Refreshes the status of the files, hashes them and notifies listeners about the ones whose contents changed.
+		// Returns the files that couldn't be queried or read.
+		std::vector<std::pair<std::filesystem::path, std::error_code>> ProcessModifiedFilesByContent(
+			const std::vector<std::shared_ptr<DirectoryEntry>>& files);
 
 		std::shared_ptr<Directory> rootDir;
 		std::filesystem::path rootDirAbsParentPath;
 
+		size_t buildThreadCount{ 1 };
+
+		DirEntrySortType sortType{ DirEntrySortType::ALPHABETICAL_L_TO_H };
+
+		bool lazyExpansion{ false };
+		bool lazyPrefetch{ false };
+		std::vector<std::pair<std::filesystem::path, std::error_code>> expansionErrors;
+		std::vector<std::pair<std::filesystem::path, std::error_code>> modificationErrors;
+
+		DirectoryScanner scanner;
+		StatusRefresher statusRefresher;
+
 		// Callbacks
 
 		std::vector<DirectoryTreeEventListener*> listeners;
+
+		// Prefetched listings are written by the prefetch pool, everything else is only touched by the owning thread
+
+		struct PrefetchedListing
+		{
+			std::vector<ScannedEntry> entries;
+			// Tells apart listings requested again for the same path while an older request was still running
+			uint64_t requestIndex{ 0 };
+			bool ready{ false };
+		};
+
+		std::unordered_map<
+			std::filesystem::path,
+			PrefetchedListing> prefetchedListings;
+		uint64_t prefetchRequestCount{ 0 };
+		std::mutex prefetchMutex;
+
+		// Versioning
+
+		std::unique_ptr<VersionTracker> versionTracker;
+		std::shared_ptr<const TreeVersion> publishedVersion;
+		uint64_t publishedVersionCount{ 0 };
+		size_t updateDepth{ 0 };
+
+		std::unique_ptr<ExtensionIndex> extensionIndex;
+		std::unique_ptr<NameSearchIndex> nameSearchIndex;
+		std::unique_ptr<ContentHasher> contentHasher;
+		std::unique_ptr<DuplicateFinder> duplicateFinder;
+
+		// Declared last, so that its workers are joined before anything they use is destroyed
+		std::unique_ptr<impl::TaskPool> prefetchPool;
 	};
 }
\ No newline at end of file
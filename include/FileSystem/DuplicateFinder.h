@@ -0,0 +1,115 @@
+#pragma once
+
+#include "ContentHasher.h"
+#include "DirectoryTree.h"
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <set>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fs
+{
+	// Files with the same contents
+	struct DuplicateGroup
+	{
+		uint64_t size;
+		uint64_t contentHash;
+		// At least two, in no particular order
+		std::vector<std::shared_ptr<File>> files;
+	};
+
+	// Finds files with the same contents.
+	//
+	// Files are grouped by their sizes as they're added, which costs nothing since the sizes are already known.
+	// 'Update' only reads the groups that changed since the last call, and only the files that could still have
+	// a duplicate: the first block of every file in a group of at least two is hashed, and only files that share
+	// that hash with another one are hashed completely (through 'ContentHasher', so its thread count bounds how many
+	// files are read at once and its cache skips files that were read before). Files that already have a content hash
+	// (see 'DirectoryTree::SetContentHashing') aren't read again, the tree drops the hash of every file it finds modified,
+	// so the hashes it keeps match the current contents. Empty files are ignored.
+	// Kept up to date by 'DirectoryTree' (see 'DirectoryTree::SetDuplicateDetection').
+	class DuplicateFinder : public DirectoryTreeEventListener
+	{
+	public:
+
+		FS_API DuplicateFinder();
+		FS_API ~DuplicateFinder();
+
+		FS_API void OnFileAdded(std::shared_ptr<File> file) override;
+		FS_API void OnDirectoryAdded(std::shared_ptr<Directory> dir) override;
+
+		FS_API void OnFileRemoved(std::shared_ptr<File> file) override;
+		FS_API void OnDirectoryRemoved(std::shared_ptr<Directory> dir) override;
+
+		// Contents don't change when paths do, nothing to do
+		FS_API void OnFilePathChanged(std::shared_ptr<File> file, const std::filesystem::path& oldPath) override;
+		FS_API void OnDirectoryPathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath) override;
+		FS_API void OnSubtreePathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath) override;
+
+		// The file is read again by the next 'Update'
+		FS_API void OnFileModified(std::shared_ptr<File> file) override;
+		FS_API void OnDirectoryModified(std::shared_ptr<Directory> dir) override;
+
+		FS_API void Clear();
+
+		// Reads whatever changed since the last call, 'absPart' is what the paths of the files are relative to.
+		// Returns the files that couldn't be read, they're left out until they change again or their group does.
+		FS_API std::vector<std::pair<std::filesystem::path, std::error_code>> Update(const std::filesystem::path& absPart);
+
+		// As of the last 'Update', largest files first
+		FS_API std::vector<DuplicateGroup> GetDuplicateGroups() const;
+		FS_API size_t GetDuplicateGroupCount() const;
+		// Bytes taken by all the copies but one of every group
+		FS_API uint64_t GetWastedSize() const;
+
+		// Threads and the hash cache are set up through it
+		FS_API ContentHasher& GetContentHasher();
+
+	private:
+
+		struct TrackedFile
+		{
+			std::shared_ptr<File> file;
+			uint64_t prefixHash{ 0 };
+			uint64_t contentHash{ 0 };
+			bool hasPrefixHash{ false };
+			bool hasContentHash{ false };
+			// Couldn't be read during the current 'Update'
+			bool failed{ false };
+		};
+
+		struct SizeGroup
+		{
+			std::vector<TrackedFile> files;
+			std::vector<DuplicateGroup> duplicates;
+			bool dirty{ false };
+		};
+
+		void Insert(std::shared_ptr<File> file);
+		void Erase(const File& file);
+		void MarkDirty(uint64_t size, SizeGroup& group);
+		// Rebuilds the duplicates of a group whose files have all the hashes they need
+		void FindDuplicates(uint64_t size, SizeGroup& group);
+		void ForgetDuplicates(uint64_t size, SizeGroup& group);
+
+		std::unordered_map<uint64_t, SizeGroup> sizeGroups;
+		// Size of every tracked file when it was added, which is the group it's in
+		std::unordered_map<const File*, uint64_t> fileSizes;
+		std::vector<uint64_t> dirtySizes;
+
+		std::set<uint64_t, std::greater<uint64_t>> sizesWithDuplicates;
+		size_t duplicateGroupCount{ 0 };
+		uint64_t wastedSize{ 0 };
+
+		ContentHasher hasher;
+	};
+}
\ No newline at end of file
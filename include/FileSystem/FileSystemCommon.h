@@ -1,11 +1,16 @@
 #pragma once
 
 #include "FileSystemApi.h"
+#include "InternedName.h"
+#include "NameIndex.h"
 
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -79,12 +84,23 @@ namespace fs
 		virtual bool IsFile() const = 0;
 		virtual bool IsDirectory() const = 0;
 		virtual DirectoryEntryType GetDirectoryEntryType() const = 0;
-		virtual std::string GetName() const = 0;
+		// Names are interned (see 'impl::InternedName'), the returned view is valid
+		// as long as the entry is alive and isn't renamed
+		virtual std::string_view GetName() const = 0;
+		// Same as 'GetName', without the virtual call
+		FS_API std::string_view GetNameRef() const;
 
+		// Keeps the parent's name index and sorting order up to date
 		FS_API void Rename(const std::string& newName);
 
+		// Derived from the parent's path and cached. Moving or renaming a directory doesn't touch anything inside of it,
+		// the paths of its entries are recomputed the first time they're asked for afterwards.
+		// Files with a parent don't keep a path until one is asked for, most of them never need it.
+		// An entry without a parent keeps the path it was created with.
+		// Any number of threads can call it at once as long as nothing changes the tree in the meantime.
+		// The returned reference stays valid until the entry or one of its ancestors is moved or renamed.
 		FS_API const std::filesystem::path& GetPath() const;
-		FS_API virtual void UpdatePath();
+		FS_API void UpdatePath();
 
 		FS_API void SetParentDirectory(std::shared_ptr<Directory> parentDir);
 		FS_API void ClearParentDirectory();
@@ -94,13 +110,26 @@ namespace fs
 		FS_API bool Exists() const;
 
 		FS_API void UpdateStatus(const std::filesystem::path& absPart);
+		// Same as above, but with the current last write time already queried by the caller
+		FS_API void UpdateStatus(std::filesystem::file_time_type currentLastWriteTime);
 		FS_API bool Modified() const;
 
 		FS_API std::filesystem::file_time_type GetLastWriteTime() const;
+		// Sets 'lastWriteTime' obtained elsewhere (a directory scan for example) and resets 'modified'
+		FS_API void SetLastWriteTime(std::filesystem::file_time_type lastWriteTime);
 
 	protected:
 
-		std::filesystem::path dirEntryPath;
+		// Keeps the subtree summaries of the ancestors of a file up to date
+		void OnLastWriteTimeChanged(std::filesystem::file_time_type oldLastWriteTime);
+
+		// The key of the parent's name index, shared with every other entry of the same name
+		impl::InternedName name;
+
+		// Valid as long as 'cachedPathGeneration' matches the global path generation,
+		// which is bumped every time a directory with entries in it gets a different path
+		mutable std::filesystem::path cachedPath;
+		mutable std::atomic<uint64_t> cachedPathGeneration;
 
 		std::filesystem::file_time_type lastWriteTime{};
 
@@ -109,8 +138,30 @@ namespace fs
 		bool modified{ false };
 	};
 
+	// Totals of everything that's loaded under a directory, the directory itself not included
+	struct SubtreeSummary
+	{
+		size_t fileCount{ 0 };
+		size_t directoryCount{ 0 };
+		// Sum of the sizes of the files in bytes
+		uint64_t totalSize{ 0 };
+		// Newest last write time of the files, 'file_time_type::min()' if there are none
+		std::filesystem::file_time_type newestLastWriteTime{ std::filesystem::file_time_type::min() };
+	};
+
 	class File;
 	class Sorter;
+	class SortedView;
+	class RecursiveDirectoryIterator;
+	class GlobQueryIterator;
+
+	// Fills a lazily expanded directory with its entries the first time they're needed (see 'Directory::SetExpander')
+	class DirectoryExpander
+	{
+	public:
+		// Returns false if the entries couldn't be listed, the directory stays unexpanded then
+		virtual bool ExpandDirectory(Directory& dir) = 0;
+	};
 
 	// Directory
 
@@ -131,9 +182,7 @@ namespace fs
 		FS_API bool IsFile() const override;
 		FS_API bool IsDirectory() const override;
 		FS_API DirectoryEntryType GetDirectoryEntryType() const override;
-		FS_API std::string GetName() const override;
-
-		FS_API void UpdatePath() override;
+		FS_API std::string_view GetName() const override;
 
 		FS_API void AddDirectoryEntry(std::shared_ptr<DirectoryEntry> entry);
 		FS_API void AddDirectory(std::shared_ptr<Directory> dir);
@@ -157,7 +206,7 @@ namespace fs
 
 		FS_API bool IsEmpty() const;
 
-		FS_API std::string GetDirectoryName() const;
+		FS_API std::string_view GetDirectoryName() const;
 
 		FS_API std::vector<std::shared_ptr<Directory>> GetDirectories() const;
 		FS_API std::vector<std::shared_ptr<Directory>> GetDirectoriesRecursive() const;
@@ -170,19 +219,106 @@ namespace fs
 		FS_API DirEntrySortType GetSortingType() const;
 		FS_API void SetSortingType(DirEntrySortType sortType);
 
+		// Bulk appending
+		//
+		// Between these two calls added entries are appended in whatever order they come in instead of being inserted
+		// at their sorted place one at a time, which costs O(N^2) moves for a directory filled with N entries.
+		// 'EndBulkAppend' sorts what was appended once and merges it with the entries that were there before,
+		// name indices are built then as well. Looking entries up by name still works in the meantime,
+		// the order of the getters is unspecified until it ends.
+		FS_API void BeginBulkAppend();
+		FS_API void EndBulkAppend();
+
+		// Lazy expansion
+		//
+		// A directory with an expander starts unexpanded: its entries are only listed when something
+		// asks for them (any getter above, searching by name, 'IsEmpty'), the recursive getters expand the whole subtree.
+		// Directories without an expander are always expanded. A directory whose entries couldn't be listed
+		// stays unexpanded and empty, the next time something asks for them they're listed again.
+		FS_API void SetExpander(DirectoryExpander* expander);
+		FS_API bool IsExpanded() const;
+		FS_API void Expand();
+
+		// Unlike the getters above these never expand the directory, they only return what's been loaded so far
+		FS_API const Directories& GetLoadedDirectories() const;
+		FS_API const Files& GetLoadedFiles() const;
+		// Returns a default constructed 'shared_ptr<Directory>' object if there's no such loaded directory
+		FS_API std::shared_ptr<Directory> GetLoadedDirectory(const std::string& dirName) const;
+
+		// Subtree summary
+		//
+		// Kept up to date by every entry that's added, removed or moved and by every file whose size or last write time
+		// changes, so reading it costs nothing. A change walks up through the ancestors once. Only when the newest file
+		// of a directory goes away (or gets older) does the directory look through its own entries for the next newest one.
+		// Like the 'GetLoaded...' functions it never expands anything, an unexpanded directory counts as an empty one.
+		FS_API const SubtreeSummary& GetSubtreeSummary() const;
+
 	private:
 
+		void ExpandIfNeeded() const;
+
+		// Visits every directory under this one (expanding them) in the order of 'GetDirEntriesRecursive'
+		template <typename Function>
+		void ForEachDirectoryRecursive(Function function) const;
+
 		void SortDirectories();
 		void SortFiles();
 
 		void InsertDirectorySorted(std::shared_ptr<Directory> dir);
 		void InsertFileSorted(std::shared_ptr<File> file);
+		// Builds the name indices of directories that have grown past the threshold
+		void IndexNamesIfNeeded();
+
+		// 'indexedName' is the name the entry is known by in the name index
+		void EraseDirectory(Directories::iterator dir, std::string_view indexedName);
+		void EraseFile(Files::iterator file, std::string_view indexedName);
+
+		// Return nullptr if there's no such entry
+		const std::shared_ptr<Directory>* FindDirectory(std::string_view dirName) const;
+		const std::shared_ptr<File>* FindFile(std::string_view fileName) const;
+
+		friend class RecursiveDirectoryIterator;
+		friend class GlobQueryIterator;
+		friend class DirectoryTree;
+
+		friend class DirectoryEntry;
+		void OnEntryRenamed(DirectoryEntry& entry, std::string_view oldName);
+
+		friend class SortedView;
+		// Moves the entry to its new place in every view of this directory
+		void OnEntrySortKeyChanged(const DirectoryEntry& entry);
+
+		friend class File;
+		// Replaces what one entry contributes to the summaries of this directory and of its ancestors,
+		// 'removed' is what it used to contribute and 'added' is what it contributes now
+		void ReplaceInSubtreeSummaries(SubtreeSummary removed, SubtreeSummary added);
+		// What this directory contributes to its parent's summary
+		SubtreeSummary GetSubtreeContribution() const;
+		std::filesystem::file_time_type FindNewestLastWriteTime() const;
 
 		Directories directories;
 		Files files;
 
-		std::shared_ptr<Sorter> sorter;
+		// Only built for directories with many entries, small ones are just scanned
+		impl::NameIndex<Directory> directoryIndex;
+		impl::NameIndex<File> fileIndex;
+
+		// Shared by every directory with the same sorting type
+		Sorter* sorter{ nullptr };
 		DirEntrySortType sortType{ DirEntrySortType::ALPHABETICAL_L_TO_H };
+
+		// Entries before these are sorted, the ones after them were appended since 'BeginBulkAppend'
+		size_t sortedDirectoryCount{ 0 };
+		size_t sortedFileCount{ 0 };
+		bool bulkAppending{ false };
+
+		// Every 'SortedView' of this directory, they register and unregister themselves
+		std::vector<SortedView*> views;
+
+		SubtreeSummary summary;
+
+		DirectoryExpander* expander{ nullptr };
+		bool expanded{ true };
 	};
 
 	// File
@@ -196,16 +332,30 @@ namespace fs
 		FS_API bool IsFile() const override;
 		FS_API bool IsDirectory() const override;
 		FS_API DirectoryEntryType GetDirectoryEntryType() const override;
-		FS_API std::string GetName() const override;
+		FS_API std::string_view GetName() const override;
+
+		// Like 'GetName' these point into the interned name, nothing is built
+		FS_API std::string_view GetFullFileName() const;
+		// Without the extension
+		FS_API std::string_view GetFileName() const;
+		FS_API std::string_view GetFileExtension() const;
 
-		FS_API void UpdatePath() override;
+		// Size in bytes as of the last scan or status refresh
+		FS_API uint64_t GetSize() const;
+		FS_API void SetSize(uint64_t size);
 
-		FS_API std::string GetFullFileName() const;
-		FS_API std::string GetFileName() const;
-		FS_API std::string GetFileExtension() const;
+		// Hash of the file's contents, only there once it has been hashed (see 'DirectoryTree::SetContentHashing')
+		FS_API bool HasContentHash() const;
+		// Returns 0 if the file hasn't been hashed
+		FS_API uint64_t GetContentHash() const;
+		FS_API void SetContentHash(uint64_t contentHash);
+		FS_API void ClearContentHash();
 
 	private:
 
+		uint64_t size{ 0 };
+		uint64_t contentHash{ 0 };
+		bool hasContentHash{ false };
 	};
 
 	// Sorters
@@ -235,6 +385,16 @@ namespace fs
 			std::shared_ptr<File> file,
 			std::vector<std::shared_ptr<File>>& files) = 0;
 
+		// The first 'sortedCount' entries are already sorted: sorts the rest and merges the two.
+		// By default the rest is sorted with 'SortDirectories' / 'SortFiles' and merged by comparing entries
+		// through 'InsertDirectorySorted' / 'InsertFileSorted', override these to merge with the comparison directly.
+		FS_API virtual void MergeDirectories(
+			std::vector<std::shared_ptr<Directory>>& directories,
+			size_t sortedCount);
+		FS_API virtual void MergeFiles(
+			std::vector<std::shared_ptr<File>>& files,
+			size_t sortedCount);
+
 	private:
 
 		SortCompFun comp{ SortCompFun::LESS };
@@ -255,6 +415,13 @@ namespace fs
 		FS_API void InsertFileSorted(
 			std::shared_ptr<File> file,
 			std::vector<std::shared_ptr<File>>& files) override;
+
+		FS_API void MergeDirectories(
+			std::vector<std::shared_ptr<Directory>>& directories,
+			size_t sortedCount) override;
+		FS_API void MergeFiles(
+			std::vector<std::shared_ptr<File>>& files,
+			size_t sortedCount) override;
 	};
 
 	class LastWriteTimeSorter : public Sorter
@@ -272,5 +439,12 @@ namespace fs
 		FS_API void InsertFileSorted(
 			std::shared_ptr<File> file,
 			std::vector<std::shared_ptr<File>>& files) override;
+
+		FS_API void MergeDirectories(
+			std::vector<std::shared_ptr<Directory>>& directories,
+			size_t sortedCount) override;
+		FS_API void MergeFiles(
+			std::vector<std::shared_ptr<File>>& files,
+			size_t sortedCount) override;
 	};
 }
\ No newline at end of file
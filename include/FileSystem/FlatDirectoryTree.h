@@ -0,0 +1,134 @@
+#pragma once
+
+#include "DirectoryScanner.h"
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs
+{
+	// Refers to an entry of a 'FlatDirectoryTree'. A handle becomes stale when its entry is removed
+	// (or the tree is cleared or compacted), stale handles are detected and treated as invalid ones.
+	struct FlatEntryHandle
+	{
+		static constexpr uint32_t invalidIndex{ UINT32_MAX };
+
+		uint32_t index{ invalidIndex };
+		uint32_t generation{ 0 };
+
+		bool operator==(const FlatEntryHandle& other) const
+		{
+			return index == other.index && generation == other.generation;
+		}
+		bool operator!=(const FlatEntryHandle& other) const
+		{
+			return !(*this == other);
+		}
+	};
+
+	// Alternative to 'DirectoryTree' for very large trees that are mostly traversed.
+	//
+	// Entries aren't separate objects: every attribute lives in its own array indexed by the entry index
+	// (structure of arrays), names are packed into one character buffer and children are linked through indices.
+	// A freshly built (or compacted) tree keeps the children of every directory next to each other,
+	// so walking it touches memory mostly sequentially, and clearing it only frees a handful of arrays.
+	// Children are kept in alphabetical order. Nothing is shared between threads, use it from one thread at a time.
+	class FlatDirectoryTree
+	{
+	public:
+
+		FS_API void SetScannerBackend(DirectoryScannerBackend backend);
+		FS_API DirectoryScannerBackend GetScannerBackend() const;
+
+		// Replaces the current contents with the tree under 'rootDirAbsPath'.
+		// Throws 'std::filesystem::filesystem_error' if the root directory can't be listed,
+		// subdirectories that can't be listed are left empty.
+		FS_API void BuildRootTree(const std::filesystem::path& rootDirAbsPath);
+		FS_API void ClearTree();
+
+		// Rebuilds the arrays in depth-first order and drops the names of removed entries.
+		// Invalidates every handle.
+		FS_API void Compact();
+
+		// Returns an invalid handle if 'parentDir' isn't a valid directory or already has an entry with this name
+		FS_API FlatEntryHandle AddEntry(
+			FlatEntryHandle parentDir,
+			std::string_view name,
+			DirectoryEntryType type,
+			std::filesystem::file_time_type lastWriteTime);
+		// Removes the entry together with everything under it. The root can't be removed.
+		FS_API void RemoveEntry(FlatEntryHandle entry);
+		FS_API void SetLastWriteTime(FlatEntryHandle entry, std::filesystem::file_time_type lastWriteTime);
+
+		FS_API bool IsValid(FlatEntryHandle entry) const;
+
+		FS_API FlatEntryHandle GetRootDirectory() const;
+		// Same relative paths 'DirectoryTree' uses ("Assets/Textures")
+		FS_API FlatEntryHandle GetEntry(const std::filesystem::path& relPath) const;
+		FS_API FlatEntryHandle GetChild(FlatEntryHandle dir, std::string_view name) const;
+
+		FS_API FlatEntryHandle GetParent(FlatEntryHandle entry) const;
+		FS_API FlatEntryHandle GetFirstChild(FlatEntryHandle dir) const;
+		FS_API FlatEntryHandle GetNextSibling(FlatEntryHandle entry) const;
+
+		// Accessors expect a valid handle
+		FS_API std::string_view GetName(FlatEntryHandle entry) const;
+		FS_API DirectoryEntryType GetType(FlatEntryHandle entry) const;
+		FS_API std::filesystem::file_time_type GetLastWriteTime(FlatEntryHandle entry) const;
+		// Built by walking up to the root
+		FS_API std::filesystem::path GetPath(FlatEntryHandle entry) const;
+
+		// Visits every entry in the order they're stored in, which is a plain scan over the arrays
+		FS_API void ForEachEntry(const std::function<void(FlatEntryHandle)>& function) const;
+
+		FS_API size_t GetEntryCount() const;
+		// Bytes allocated by the arrays, including unused capacity
+		FS_API size_t GetMemoryUsage() const;
+
+	private:
+
+		uint32_t CreateEntry(
+			uint32_t parent,
+			std::string_view name,
+			DirectoryEntryType type,
+			std::filesystem::file_time_type lastWriteTime);
+		void LinkChild(uint32_t parent, uint32_t child);
+		void UnlinkChild(uint32_t child);
+
+		void ScanChildren(uint32_t dir, const std::filesystem::path& dirAbsPath);
+
+		FlatEntryHandle MakeHandle(uint32_t index) const;
+
+		// Attributes, indexed by entry index
+
+		std::vector<uint32_t> nameOffsets;
+		std::vector<uint32_t> nameLengths;
+		std::vector<uint32_t> parents;
+		std::vector<uint32_t> firstChildren;
+		std::vector<uint32_t> nextSiblings;
+		// 'DirectoryEntryType'
+		std::vector<uint8_t> types;
+		std::vector<std::filesystem::file_time_type> lastWriteTimes;
+		// Bumped every time a slot is freed, so that handles to the removed entry stop matching
+		std::vector<uint32_t> generations;
+
+		std::string names;
+
+		// Slots of removed entries, their type is 'UNDEFINED'
+		std::vector<uint32_t> freeSlots;
+		// Generation of newly created slots. Larger than any generation used before 'ClearTree' or 'Compact',
+		// so handles from before don't match the new entries.
+		uint32_t generationBase{ 0 };
+
+		std::filesystem::path rootDirAbsParentPath;
+
+		DirectoryScanner scanner;
+	};
+}
\ No newline at end of file
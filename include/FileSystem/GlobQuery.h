@@ -0,0 +1,228 @@
+#pragma once
+
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs
+{
+	// A set of glob patterns compiled once and matched against the relative paths of a 'DirectoryTree'
+	// ("Assets/Textures/Stone.png", the root directory's name comes first).
+	//
+	// Syntax, per path component:
+	//   *        any number of characters
+	//   ?        one character (a byte, for names that aren't ASCII)
+	//   [abc]    one of the listed characters, ranges ("[a-z]") and negation ("[!abc]" or "[^abc]") included
+	//   {a,b}    any of the alternatives, which may contain everything else (nested braces and slashes too)
+	//   **       a whole component only: any number of components, none included
+	// A pattern starting with '!' excludes what it matches, an excluded directory excludes everything under it.
+	// A pattern ending with '/' only matches directories. Matching is case-sensitive, '[' and '{'
+	// without their closing brackets are plain characters.
+	//
+	// The patterns become one automaton whose states are "the next component has to match this component
+	// of that pattern", so every entry is matched by looking at its name only, never at its full path,
+	// and a directory none of the states survives in is skipped together with everything under it.
+	class GlobQuery
+	{
+	public:
+
+		FS_API explicit GlobQuery(const std::string& pattern);
+		FS_API explicit GlobQuery(const std::vector<std::string>& patterns);
+
+		// For paths that aren't in a tree, events of a watcher for example
+		FS_API bool Matches(const std::filesystem::path& path, DirectoryEntryType type) const;
+
+	private:
+
+		friend class GlobQueryIterator;
+
+		enum class TokenType
+		{
+			LITERAL,
+			ANY_CHAR,
+			CHAR_CLASS,
+			ANY_CHARS
+		};
+
+		struct Token
+		{
+			TokenType type;
+			// LITERAL only
+			std::string literal;
+			// CHAR_CLASS only, index into 'charClasses'
+			size_t charClass;
+		};
+
+		enum class StateType
+		{
+			// The component has to be equal to 'literal'
+			LITERAL,
+			// The component has to match 'tokens'
+			WILDCARD,
+			// '**'
+			ANY_COMPONENTS,
+			// The whole pattern matched
+			ACCEPT
+		};
+
+		// One per pattern component, plus an 'ACCEPT' state at the end of every pattern.
+		// The state that follows a matched component is always the next one.
+		struct State
+		{
+			StateType type;
+			bool exclude;
+			// ACCEPT only
+			bool directoriesOnly;
+
+			std::string literal;
+			std::vector<Token> tokens;
+			// Checked before running 'tokens', both are empty for patterns starting or ending with a wildcard
+			std::string prefix;
+			std::string suffix;
+			size_t minLength;
+			// 'prefix', one '*' and 'suffix' is all there is, so the checks above decide on their own
+			bool prefilterDecides;
+		};
+
+		void AddPattern(const std::string& pattern);
+		void CompilePattern(const std::string& pattern, bool exclude);
+		State CompileComponent(std::string_view component, bool exclude);
+		size_t CompileCharClass(std::string_view component, size_t begin, std::bitset<256>& charClass) const;
+
+		bool MatchesComponent(const State& state, std::string_view name) const;
+		bool MatchesTokens(const State& state, std::string_view name) const;
+
+		// Appends 'state' and everything reachable from it without consuming a component,
+		// states already marked with 'mark' are skipped
+		void AddState(uint32_t state, std::vector<uint32_t>& set, std::vector<uint32_t>& marks, uint32_t mark) const;
+		// Appends the states reached from 'set[begin, end)' by a component named 'name'
+		void Step(
+			size_t begin,
+			size_t end,
+			std::string_view name,
+			std::vector<uint32_t>& set,
+			std::vector<uint32_t>& marks,
+			uint32_t mark) const;
+
+		struct Verdict
+		{
+			bool matched{ false };
+			bool excluded{ false };
+			// Something under a directory in this state could still match
+			bool live{ false };
+			// Every live state is a literal one, so the children can be looked up by name instead of scanned
+			bool literalsOnly{ true };
+		};
+		Verdict Judge(const uint32_t* set, size_t count, bool isDirectory) const;
+
+		std::vector<State> states;
+		std::vector<uint32_t> startStates;
+		std::vector<std::bitset<256>> charClasses;
+	};
+
+	// Streams the entries of a tree matching a 'GlobQuery' in pre-order (a directory comes before its entries,
+	// files before subdirectories), the query has to outlive it. Like 'RecursiveDirectoryIterator' it walks
+	// the tree in place, hands out entries by reference and is invalidated by changes made to the tree.
+	// Only directories something could match in are entered, components without wildcards are looked up
+	// by name instead of scanning every entry of their parent.
+	class GlobQueryIterator
+	{
+	public:
+
+		using iterator_category = std::input_iterator_tag;
+		using value_type = DirectoryEntry;
+		using difference_type = std::ptrdiff_t;
+		using pointer = DirectoryEntry*;
+		using reference = DirectoryEntry&;
+
+		// The end iterator
+		FS_API GlobQueryIterator();
+		// 'rootDirEntry' is the root directory of a tree and has to outlive the iterator as well.
+		// With 'expand' lazily expanded directories are expanded when the walk enters them.
+		FS_API GlobQueryIterator(const std::shared_ptr<Directory>& rootDirEntry, const GlobQuery& query, bool expand = true);
+
+		FS_API DirectoryEntry& operator*() const;
+		FS_API DirectoryEntry* operator->() const;
+		FS_API GlobQueryIterator& operator++();
+
+		FS_API bool operator==(const GlobQueryIterator& other) const;
+		FS_API bool operator!=(const GlobQueryIterator& other) const;
+
+		// Only valid for the matching type of the current entry
+		FS_API const std::shared_ptr<File>& GetFile() const;
+		FS_API const std::shared_ptr<Directory>& GetDirectory() const;
+		FS_API std::shared_ptr<DirectoryEntry> GetEntry() const;
+
+	private:
+
+		// Children of a directory whose live states are all literal, found by name
+		struct Candidate
+		{
+			const std::shared_ptr<File>* file;
+			const std::shared_ptr<Directory>* dir;
+		};
+
+		struct Level
+		{
+			const Directory* dir;
+			// Scanning: files first, then directories. Looking up: index into the level's candidates.
+			size_t nextIndex;
+			// Ranges in 'states' and 'candidates'
+			size_t statesBegin;
+			size_t statesEnd;
+			size_t candidatesBegin;
+			size_t candidatesEnd;
+			bool lookUp;
+		};
+
+		void PushLevel(const std::shared_ptr<Directory>& dir, size_t statesBegin, bool literalsOnly);
+		void Advance();
+		// Matches an entry of the directory in state 'states[begin, end)', returns true if it's handed out
+		bool Visit(size_t begin, size_t end, const std::shared_ptr<File>* file, const std::shared_ptr<Directory>* dir);
+		uint32_t NextMark();
+
+		std::vector<Level> stack;
+		// State sets of every level on the stack, one after another
+		std::vector<uint32_t> states;
+		std::vector<uint32_t> marks;
+		uint32_t mark{ 0 };
+		std::vector<Candidate> candidates;
+
+		const std::shared_ptr<File>* currentFile{ nullptr };
+		const std::shared_ptr<Directory>* currentDir{ nullptr };
+		// The current directory is entered on the next increment, its states are at the end of 'states'
+		bool enterCurrentDir{ false };
+		size_t currentDirStatesBegin{ 0 };
+		bool currentDirLiteralsOnly{ false };
+
+		const GlobQuery* query{ nullptr };
+		bool expand{ true };
+	};
+
+	// Makes the iterator above usable in range-based for loops. The range keeps its own copy of the query,
+	// so a temporary one can be passed, the iterators it returns can't outlive it.
+	class GlobQueryRange
+	{
+	public:
+
+		FS_API GlobQueryRange(std::shared_ptr<Directory> rootDir, GlobQuery query, bool expand = true);
+
+		FS_API GlobQueryIterator begin() const;
+		FS_API GlobQueryIterator end() const;
+
+	private:
+
+		std::shared_ptr<Directory> rootDir;
+		GlobQuery query;
+		bool expand;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace impl
+{
+	// A name kept once for every entry that has it.
+	//
+	// Names live in one table shared by all trees (from any thread), "src", "index.js" or "Makefile" are stored
+	// a single time no matter how many directories have one. Every name knows where its extension starts,
+	// so the name, its stem and its extension are all views into it and none of them is ever built again.
+	// Copies share the name, it's freed when the last one goes away.
+	class InternedName
+	{
+	public:
+
+		// The empty name
+		InternedName() = default;
+		explicit InternedName(std::string_view name);
+
+		InternedName(const InternedName& other);
+		InternedName(InternedName&& other) noexcept;
+		InternedName& operator=(const InternedName& other);
+		InternedName& operator=(InternedName&& other) noexcept;
+		~InternedName();
+
+		// Valid as long as this object (or a copy of it) is alive and isn't assigned another name
+		std::string_view GetName() const
+		{
+			return record ? std::string_view{ record->GetChars(), record->size } : std::string_view{};
+		}
+		// Everything before the extension, "image" for "image.png"
+		std::string_view GetStem() const
+		{
+			return GetName().substr(0, record ? record->extensionOffset : 0);
+		}
+		// Same rules as 'std::filesystem::path::extension', ".png" for "image.png",
+		// nothing for ".gitignore", "." or ".."
+		std::string_view GetExtension() const
+		{
+			return GetName().substr(record ? record->extensionOffset : 0);
+		}
+
+		// Distinct names currently in the table
+		static size_t GetTableSize();
+
+	private:
+
+		// Allocated together with the characters of the name, which follow it
+		struct Record
+		{
+			std::atomic<uint32_t> refCount;
+			uint32_t hash;
+			uint32_t size;
+			uint32_t extensionOffset;
+
+			const char* GetChars() const
+			{
+				return reinterpret_cast<const char*>(this + 1);
+			}
+		};
+
+		friend class NameTable;
+		void Release();
+
+		Record* record{ nullptr };
+	};
+}
\ No newline at end of file
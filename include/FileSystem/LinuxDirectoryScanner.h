@@ -0,0 +1,33 @@
+#pragma once
+
+#include "DirectoryScanner.h"
+
+#include <ctime>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+namespace fs
+{
+	// Walks directories with directory file descriptors: one 'open' + 'getdents64' loop per directory
+	// and a single 'fstatat' relative to the directory descriptor per entry. 'd_type' is used to
+	// classify entries, 'st_mode' only when the file system doesn't fill 'd_type' in or the entry is a symlink.
+	class LinuxDirectoryScanner
+	{
+	public:
+
+		static void ScanDirectory(
+			const std::filesystem::path& dirAbsPath,
+			std::vector<ScannedEntry>& entries);
+
+		static std::filesystem::file_time_type GetLastWriteTime(
+			const std::filesystem::path& absPath,
+			std::error_code& error);
+		static EntryStatus GetStatus(
+			const std::filesystem::path& absPath,
+			std::error_code& error);
+
+		// Converts a 'stat'/'statx' timestamp to the clock 'std::filesystem' uses
+		static std::filesystem::file_time_type ToFileTime(time_t seconds, long nanoseconds);
+	};
+}
\ No newline at end of file
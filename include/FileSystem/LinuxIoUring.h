@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace fs
+{
+	// Minimal io_uring wrapper (raw system calls, no liburing) that runs batches of 'statx' requests.
+	// 'IORING_OP_STATX' needs Linux 5.6 or newer. Check 'IsValid()' after construction,
+	// the ring can't be created on older kernels or when io_uring is disabled.
+	class LinuxIoUring
+	{
+	public:
+
+		explicit LinuxIoUring(unsigned entries);
+		~LinuxIoUring();
+
+		LinuxIoUring(const LinuxIoUring&) = delete;
+		LinuxIoUring& operator=(const LinuxIoUring&) = delete;
+
+		bool IsValid() const;
+
+		// Runs 'statx' (following symlinks) for every path in 'absPaths'.
+		// 'errors[i]' is 0 on success or the 'errno' value of the failed request.
+		// Returns false if the kernel doesn't support 'IORING_OP_STATX' or the ring failed,
+		// in which case the results must not be used. Every request the kernel took has completed by then,
+		// so the buffers can be freed right away.
+		bool Statx(
+			const std::vector<std::string>& absPaths,
+			std::vector<struct statx>& results,
+			std::vector<int>& errors);
+
+	private:
+
+		void Destroy();
+
+		// 'toSubmit' is left with the number of entries the kernel didn't take, which is 0 on success
+		bool SubmitAndWait(unsigned& toSubmit, unsigned minComplete);
+		// Reaps 'count' completions without looking at them, used before giving up on a batch
+		// so that no request still points into the caller's buffers
+		void WaitForCompletions(unsigned count);
+
+		int ringFd{ -1 };
+
+		void* sqRing{ nullptr };
+		void* cqRing{ nullptr };
+		void* sqes{ nullptr };
+
+		size_t sqRingSize{ 0 };
+		size_t cqRingSize{ 0 };
+		size_t sqesSize{ 0 };
+
+		unsigned* sqHead{ nullptr };
+		unsigned* sqTail{ nullptr };
+		unsigned* sqMask{ nullptr };
+		unsigned* sqArray{ nullptr };
+		unsigned sqEntries{ 0 };
+
+		unsigned* cqHead{ nullptr };
+		unsigned* cqTail{ nullptr };
+		unsigned* cqMask{ nullptr };
+		void* cqes{ nullptr };
+	};
+}
\ No newline at end of file
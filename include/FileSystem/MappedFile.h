@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace impl
+{
+	// Read-only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Returns false if the file can't be opened or mapped. Empty files can't be mapped either.
+		bool Open(const std::filesystem::path& filePath);
+		void Close();
+
+		bool IsOpen() const;
+
+		const std::byte* GetData() const;
+		size_t GetSize() const;
+
+	private:
+
+		const std::byte* data{ nullptr };
+		size_t size{ 0 };
+
+#ifdef _WIN32
+		void* fileHandle{ nullptr };
+		void* mappingHandle{ nullptr };
+#endif
+	};
+
+	// Whether a file of 'fileSize' bytes is exactly a header, 'recordCount' records and 'tailSize' more bytes.
+	// The counts come from the file itself, so they're only ever subtracted from its size, a corrupted file
+	// can't make anything wrap around and pass.
+	bool HasFileLayout(size_t fileSize, size_t headerSize, uint64_t recordCount, size_t recordSize, uint64_t tailSize);
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace impl
+{
+	// Open-addressing hash index of directory entries by their names.
+	//
+	// Linear probing, deletion shifts the following slots back instead of leaving tombstones,
+	// so lookups never get slower after many insertions and deletions. The hash of every entry is kept
+	// in its slot, probing compares names only when the hashes match and growing never touches the names.
+	// 'Entry' has to provide 'std::string_view GetNameRef() const'.
+	template <typename Entry>
+	class NameIndex
+	{
+	public:
+
+		void Insert(const std::shared_ptr<Entry>& entry)
+		{
+			if ((count + 1) * 4 > slots.size() * 3)
+				Grow();
+
+			size_t hash = Hash(entry->GetNameRef());
+			size_t slot = hash & (slots.size() - 1);
+			while (slots[slot].entry)
+			{
+				slot = (slot + 1) & (slots.size() - 1);
+			}
+			slots[slot].hash = hash;
+			slots[slot].entry = entry;
+			count++;
+		}
+
+		// 'name' is the name the entry was inserted with
+		void Erase(std::string_view name, const Entry* entry)
+		{
+			if (count == 0)
+				return;
+
+			size_t hash = Hash(name);
+			size_t slot = hash & (slots.size() - 1);
+			while (slots[slot].entry)
+			{
+				if (slots[slot].entry.get() == entry)
+				{
+					EraseSlot(slot);
+					return;
+				}
+				slot = (slot + 1) & (slots.size() - 1);
+			}
+		}
+
+		// Returns nullptr if there's no entry with this name
+		const std::shared_ptr<Entry>* Find(std::string_view name) const
+		{
+			if (count == 0)
+				return nullptr;
+
+			size_t hash = Hash(name);
+			size_t slot = hash & (slots.size() - 1);
+			while (slots[slot].entry)
+			{
+				if (slots[slot].hash == hash && slots[slot].entry->GetNameRef() == name)
+					return &slots[slot].entry;
+				slot = (slot + 1) & (slots.size() - 1);
+			}
+			return nullptr;
+		}
+
+		void Clear()
+		{
+			slots.clear();
+			slots.shrink_to_fit();
+			count = 0;
+		}
+
+		size_t GetSize() const
+		{
+			return count;
+		}
+
+	private:
+
+		struct Slot
+		{
+			size_t hash{ 0 };
+			std::shared_ptr<Entry> entry;
+		};
+
+		static size_t Hash(std::string_view name)
+		{
+			return std::hash<std::string_view>{}(name);
+		}
+
+		void Grow()
+		{
+			std::vector<Slot> oldSlots = std::move(slots);
+			slots = std::vector<Slot>(oldSlots.empty() ? 16 : oldSlots.size() * 2);
+
+			for (auto& oldSlot : oldSlots)
+			{
+				if (!oldSlot.entry)
+					continue;
+
+				size_t slot = oldSlot.hash & (slots.size() - 1);
+				while (slots[slot].entry)
+				{
+					slot = (slot + 1) & (slots.size() - 1);
+				}
+				slots[slot] = std::move(oldSlot);
+			}
+		}
+
+		void EraseSlot(size_t slot)
+		{
+			// Moves back every following entry of the cluster that would become unreachable
+			// through the now empty slot
+			size_t mask = slots.size() - 1;
+			size_t next = (slot + 1) & mask;
+			while (slots[next].entry)
+			{
+				size_t home = slots[next].hash & mask;
+				bool canMove = ((next - home) & mask) >= ((next - slot) & mask);
+				if (canMove)
+				{
+					slots[slot] = std::move(slots[next]);
+					slot = next;
+				}
+				next = (next + 1) & mask;
+			}
+			slots[slot] = Slot{};
+			count--;
+		}
+
+		std::vector<Slot> slots;
+		size_t count{ 0 };
+	};
+}
\ No newline at end of file
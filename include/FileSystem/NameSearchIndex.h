@@ -0,0 +1,92 @@
+#pragma once
+
+#include "DirectoryTree.h"
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace fs
+{
+	enum class NameSearchMode
+	{
+		// Names containing the query
+		SUBSTRING,
+		// Names containing the query, followed by names sharing at least half of its trigrams
+		// (so typos and swapped letters still find something)
+		FUZZY
+	};
+
+	struct NameSearchResult
+	{
+		std::shared_ptr<DirectoryEntry> entry;
+		// Higher is better: whole name matches, then prefixes, then matches at the start of a word,
+		// then anywhere else (shorter names first), then fuzzy matches by how many trigrams they share
+		int score;
+	};
+
+	// Finds files and directories by parts of their names, for "quick open" style searches.
+	//
+	// Every name is split into its trigrams (ASCII letters are lowercased first, searching ignores their case),
+	// and every trigram keeps the ids of the names containing it in ascending order. Looking a query up
+	// intersects the lists of its trigrams, smallest first, and only the few names that are left are compared
+	// with the query. Queries shorter than a trigram have nothing to intersect and compare every name.
+	//
+	// Ids are handed out in increasing order, so adding a name only appends to lists. A removed name leaves
+	// its id behind as a tombstone, the lists are rebuilt once there are more tombstones than names.
+	// Kept up to date by 'DirectoryTree' (see 'DirectoryTree::SetNameSearchIndexing').
+	class NameSearchIndex : public DirectoryTreeEventListener
+	{
+	public:
+
+		FS_API void OnFileAdded(std::shared_ptr<File> file) override;
+		FS_API void OnDirectoryAdded(std::shared_ptr<Directory> dir) override;
+
+		FS_API void OnFileRemoved(std::shared_ptr<File> file) override;
+		FS_API void OnDirectoryRemoved(std::shared_ptr<Directory> dir) override;
+
+		// Only renames change anything
+		FS_API void OnFilePathChanged(std::shared_ptr<File> file, const std::filesystem::path& oldPath) override;
+		FS_API void OnDirectoryPathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath) override;
+		FS_API void OnSubtreePathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath) override;
+
+		FS_API void OnFileModified(std::shared_ptr<File> file) override;
+		FS_API void OnDirectoryModified(std::shared_ptr<Directory> dir) override;
+
+		FS_API void Clear();
+
+		// At most 'maxResults' results, best first
+		FS_API std::vector<NameSearchResult> Search(
+			std::string_view query,
+			size_t maxResults,
+			NameSearchMode mode = NameSearchMode::SUBSTRING) const;
+
+		FS_API size_t GetNameCount() const;
+
+	private:
+
+		void Insert(std::shared_ptr<DirectoryEntry> entry);
+		void Erase(const DirectoryEntry& entry);
+		void OnRenamed(std::shared_ptr<DirectoryEntry> entry, const std::filesystem::path& oldPath);
+		void Compact();
+
+		// Every name with at least one of the trigrams, 'counts[id]' is how many of them it has
+		void CountSharedTrigrams(const std::vector<uint32_t>& trigrams, std::vector<uint16_t>& counts) const;
+
+		static int ScoreSubstringMatch(std::string_view loweredName, size_t position, size_t queryLength);
+
+		// Null for removed names
+		std::vector<std::shared_ptr<DirectoryEntry>> entries;
+		std::unordered_map<const DirectoryEntry*, uint32_t> ids;
+		size_t removedCount{ 0 };
+
+		std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+
+#include <memory>
+#include <vector>
+
+namespace fs
+{
+	enum class SortViewKey
+	{
+		NAME,
+		// Runs of digits are compared by their values, so "tex2" comes before "tex10"
+		NATURAL_NAME,
+		// The one 'File::GetFileExtension' returns, directories don't have one
+		EXTENSION,
+		// Directories don't have a size, they're ordered by the remaining keys
+		SIZE,
+		LAST_WRITE_TIME
+	};
+
+	struct SortViewOrder
+	{
+		SortViewKey key;
+		Sorter::SortCompFun comp{ Sorter::SortCompFun::LESS };
+	};
+
+	// The entries of a directory in an order of their own, without touching the order the directory keeps them in,
+	// so the same directory can be shown in different orders at the same time.
+	//
+	// Entries are compared by the keys of 'order' one after another ({ EXTENSION, NAME } groups files
+	// by their extensions and sorts every group by name), entries equal in all of them by their names.
+	// The view is registered with its directory and follows every change of it as it happens: added entries are
+	// inserted at their place, removed ones are taken out, renamed entries and entries whose size or last write time
+	// changed are moved. Only a directory filled in bulk (see 'Directory::BeginBulkAppend') sorts its views again.
+	class SortedView
+	{
+	public:
+
+		// Expands the directory if it hasn't been expanded yet
+		FS_API SortedView(std::shared_ptr<Directory> dir, std::vector<SortViewOrder> order);
+		FS_API ~SortedView();
+
+		SortedView(const SortedView&) = delete;
+		SortedView& operator=(const SortedView&) = delete;
+
+		FS_API std::shared_ptr<Directory> GetDirectory() const;
+
+		FS_API const std::vector<SortViewOrder>& GetOrder() const;
+		// Only sorts this view again
+		FS_API void SetOrder(std::vector<SortViewOrder> order);
+
+		FS_API const std::vector<std::shared_ptr<Directory>>& GetDirectories() const;
+		FS_API const std::vector<std::shared_ptr<File>>& GetFiles() const;
+
+	private:
+
+		friend class Directory;
+		void OnDirectoryInserted(const std::shared_ptr<Directory>& dir);
+		void OnFileInserted(const std::shared_ptr<File>& file);
+		void OnEntryErased(const DirectoryEntry& entry);
+		void OnEntrySortKeyChanged(const DirectoryEntry& entry);
+		void Sort();
+
+		// Whether 'entry1' comes before 'entry2'
+		bool Precedes(const DirectoryEntry& entry1, const DirectoryEntry& entry2) const;
+
+		std::shared_ptr<Directory> dir;
+		std::vector<SortViewOrder> order;
+
+		std::vector<std::shared_ptr<Directory>> directories;
+		std::vector<std::shared_ptr<File>> files;
+	};
+}
\ No newline at end of file
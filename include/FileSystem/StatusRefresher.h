@@ -0,0 +1,75 @@
+#pragma once
+
+#include "DirectoryScanner.h"
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+
+#include <filesystem>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+namespace impl
+{
+	class TaskPool;
+}
+
+namespace fs
+{
+	class LinuxIoUring;
+
+	// Refreshes 'lastWriteTime' and 'modified' (and the sizes of files) of many entries at once.
+	//
+	// On Linux the 'statx' calls are submitted through io_uring. When io_uring isn't available
+	// (old kernel, disabled by the system) or on other platforms, they're spread across a thread pool.
+	class StatusRefresher
+	{
+	public:
+
+		FS_API StatusRefresher();
+		FS_API ~StatusRefresher();
+
+		// Number of threads the fallback path uses, 0 means "use as many threads as there are hardware threads"
+		FS_API void SetThreadCount(size_t threadCount);
+		FS_API size_t GetThreadCount() const;
+
+		// Does the same thing 'DirectoryEntry::UpdateStatus' does for each entry and updates the sizes of files,
+		// but instead of printing errors returns them: 'errors[i]' belongs to 'entries[i]'.
+		// Entries that failed keep their 'lastWriteTime' and size and aren't marked as modified.
+		FS_API std::vector<std::error_code> RefreshStatus(
+			const std::vector<std::shared_ptr<DirectoryEntry>>& entries,
+			const std::filesystem::path& absPart);
+
+		// Only queries the last write times without touching any entries
+		FS_API void QueryLastWriteTimes(
+			const std::vector<std::filesystem::path>& absPaths,
+			std::vector<std::filesystem::file_time_type>& lastWriteTimes,
+			std::vector<std::error_code>& errors);
+		// Same as above, together with the sizes of files
+		FS_API void QueryStatus(
+			const std::vector<std::filesystem::path>& absPaths,
+			std::vector<EntryStatus>& statuses,
+			std::vector<std::error_code>& errors);
+
+	private:
+
+		bool QueryStatusIoUring(
+			const std::vector<std::filesystem::path>& absPaths,
+			std::vector<EntryStatus>& statuses,
+			std::vector<std::error_code>& errors);
+		void QueryStatusThreadPool(
+			const std::vector<std::filesystem::path>& absPaths,
+			std::vector<EntryStatus>& statuses,
+			std::vector<std::error_code>& errors);
+
+		DirectoryScanner scanner;
+
+		std::unique_ptr<impl::TaskPool> taskPool;
+		size_t threadCount{ 0 };
+
+#ifdef __linux__
+		std::unique_ptr<LinuxIoUring> ioUring;
+		bool ioUringUnavailable{ false };
+#endif
+	};
+}
\ No newline at end of file
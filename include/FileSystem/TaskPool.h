@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace impl
+{
+	// A small work-stealing thread pool.
+	//
+	// Every worker owns a task deque. Tasks submitted from inside a worker go to the back
+	// of that worker's own deque and are taken from the back as well (LIFO, good locality
+	// for recursive work like directory scanning), while idle workers steal from the front
+	// of the other deques. Tasks submitted from outside of the pool are distributed round-robin.
+	class TaskPool
+	{
+	public:
+
+		using Task = std::function<void()>;
+
+		// 'threadCount' == 0 means "use std::thread::hardware_concurrency()"
+		explicit TaskPool(size_t threadCount = 0);
+		~TaskPool();
+
+		TaskPool(const TaskPool&) = delete;
+		TaskPool& operator=(const TaskPool&) = delete;
+
+		void Submit(Task task);
+
+		// Blocks until every submitted task (including the ones submitted by other tasks) is finished.
+		// If any of the tasks threw an exception, the first one is rethrown here.
+		void Wait();
+
+		size_t GetThreadCount() const;
+
+		// Returns the index of the worker the calling thread belongs to
+		// or 'GetThreadCount()' if it's not one of this pool's workers.
+		size_t GetCurrentWorkerIndex() const;
+
+	private:
+
+		struct WorkerQueue
+		{
+			std::deque<Task> tasks;
+			std::mutex mutex;
+		};
+
+		void WorkerLoop(size_t workerIndex);
+
+		bool PopTask(size_t workerIndex, Task& task);
+		bool StealTask(size_t workerIndex, Task& task);
+
+		void RunTask(Task& task);
+
+		std::vector<std::unique_ptr<WorkerQueue>> queues;
+		std::vector<std::thread> workers;
+
+		std::mutex stateMutex;
+		std::condition_variable taskAvailable;
+		std::condition_variable allTasksDone;
+
+		std::atomic<size_t> queuedTasks{ 0 };
+		std::atomic<size_t> pendingTasks{ 0 };
+		std::atomic<size_t> nextQueue{ 0 };
+
+		std::exception_ptr firstException;
+
+		bool exit{ false };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+namespace fs
+{
+	// Binary layout of the files written by 'DirectoryTree::SaveSnapshot'.
+	//
+	// [TreeSnapshotHeader][TreeSnapshotRecord * entryCount][names]
+	//
+	// Records are stored in pre-order, so a record's parent always comes before the record itself.
+	// Record 0 is the root directory. Names aren't null-terminated, 'nameOffset' is relative to the start of the names block.
+	// Everything is stored in the native byte order and with the native 'file_time_type' resolution,
+	// so a snapshot can only be loaded by a build of the library for the same platform.
+
+	constexpr char treeSnapshotMagic[8]{ 'F', 'S', 'T', 'R', 'E', 'E', 'S', 'N' };
+	constexpr uint32_t treeSnapshotVersion{ 2 };
+
+	// 'TreeSnapshotRecord::flags'
+	// A directory that was saved before it had been expanded, there are no records of its entries
+	constexpr uint16_t treeSnapshotUnexpandedFlag{ 1 << 0 };
+
+	struct TreeSnapshotHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordSize;
+		uint64_t entryCount;
+		uint64_t namesSize;
+		// 'file_time_type::period' the last write times were written with
+		int64_t timePeriodNum;
+		int64_t timePeriodDen;
+	};
+
+	struct TreeSnapshotRecord
+	{
+		int64_t lastWriteTime;
+		// Files only, in bytes
+		uint64_t size;
+		uint32_t parentIndex;
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		// 'DirectoryEntryType'
+		uint8_t type;
+		// 'DirEntrySortType', only used by directories
+		uint8_t sortType;
+		uint16_t flags;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "FileSystemApi.h"
+#include "FileSystemCommon.h"
+#include "InternedName.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs
+{
+	// Immutable copies of a 'DirectoryTree' that any number of threads can read while the tree keeps changing.
+	//
+	// A new version shares every unchanged subtree with the previous one, only the directories that changed
+	// and their ancestors are copied. A version (and everything reachable from it) stays valid for as long
+	// as someone holds a pointer to it, no matter how many newer versions were published since.
+	// Directories that weren't expanded when the version was published don't have any entries in it.
+	// Entries only know their names, a moved directory is shared with the versions from before the move,
+	// so the path of an entry is the path it's reached by from the root.
+
+	// TreeVersionFile
+
+	class TreeVersionFile
+	{
+	public:
+
+		FS_API TreeVersionFile(const File& file);
+
+		FS_API std::string_view GetName() const;
+
+		FS_API std::filesystem::file_time_type GetLastWriteTime() const;
+
+	private:
+
+		impl::InternedName name;
+		std::filesystem::file_time_type lastWriteTime;
+	};
+
+	// TreeVersionDirectory
+
+	class TreeVersionDirectory
+	{
+	public:
+
+		using Directories = std::vector<std::shared_ptr<const TreeVersionDirectory>>;
+		using Files = std::vector<std::shared_ptr<const TreeVersionFile>>;
+
+		FS_API TreeVersionDirectory(const Directory& dir, Files files, Directories directories);
+
+		FS_API std::string_view GetName() const;
+
+		FS_API std::filesystem::file_time_type GetLastWriteTime() const;
+		FS_API DirEntrySortType GetSortingType() const;
+		FS_API bool IsExpanded() const;
+
+		// Return a default constructed 'shared_ptr' if there's no such entry
+		FS_API std::shared_ptr<const TreeVersionDirectory> GetDirectory(const std::string& dirName) const;
+		FS_API std::shared_ptr<const TreeVersionFile> GetFile(const std::string& fileName) const;
+
+		// In the order of the directory's sorting type
+		FS_API const Directories& GetDirectories() const;
+		FS_API const Files& GetFiles() const;
+
+		FS_API Directories GetDirectoriesRecursive() const;
+		FS_API Files GetFilesRecursive() const;
+
+	private:
+
+		impl::InternedName name;
+		std::filesystem::file_time_type lastWriteTime;
+		DirEntrySortType sortType;
+		bool expanded;
+
+		Files files;
+		Directories directories;
+	};
+
+	// TreeVersion
+
+	class TreeVersion
+	{
+	public:
+
+		FS_API TreeVersion(std::shared_ptr<const TreeVersionDirectory> rootDir, uint64_t versionIndex);
+
+		FS_API std::shared_ptr<const TreeVersionDirectory> GetRootDirectory() const;
+
+		// Same relative paths 'DirectoryTree::GetDirectory' takes, but nothing is ever expanded
+		FS_API std::shared_ptr<const TreeVersionDirectory> GetDirectory(const std::filesystem::path& dirPath) const;
+
+		// Versions published by the same tree have increasing indices
+		FS_API uint64_t GetVersionIndex() const;
+
+	private:
+
+		std::shared_ptr<const TreeVersionDirectory> rootDir;
+		uint64_t versionIndex;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,601 @@
+#include "../../include/FileSystem/ContentHasher.h"
+#include "../../include/FileSystem/MappedFile.h"
+#include "../../include/FileSystem/TaskPool.h"
+
+#ifdef __linux__
+#include "../../include/FileSystem/LinuxDirectoryScanner.h"
+
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+
+namespace fs
+{
+	// Files at least this large are memory mapped, smaller ones are read into the worker's buffer in one go
+	constexpr size_t mapThreshold{ 256 * 1024 };
+	constexpr size_t readBufferSize{ mapThreshold };
+	// Files are stat'ed in tasks of this many, small files are hashed in tasks of this many
+	constexpr size_t filesPerStatTask{ 256 };
+	constexpr size_t smallFilesPerHashTask{ 32 };
+
+	// Binary layout of the files written by 'ContentHasher::SaveCache':
+	// [HashCacheHeader][HashCacheRecord * entryCount][paths]
+	// Same rules as the tree snapshots: native byte order and 'file_time_type' resolution, paths aren't null-terminated.
+
+	constexpr char hashCacheMagic[8]{ 'F', 'S', 'H', 'A', 'S', 'H', 'C', 'A' };
+	constexpr uint32_t hashCacheVersion{ 1 };
+
+	struct HashCacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t recordSize;
+		uint64_t entryCount;
+		uint64_t pathsSize;
+		int64_t timePeriodNum;
+		int64_t timePeriodDen;
+	};
+
+	struct HashCacheRecord
+	{
+		uint64_t size;
+		int64_t lastWriteTime;
+		uint64_t fileId;
+		uint64_t hash;
+		uint64_t pathOffset;
+		uint32_t pathLength;
+		uint32_t padding;
+	};
+
+	namespace
+	{
+		// XXH64, see https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md.
+		// Input is read in little-endian order, which is the native one on every platform the library is built for.
+
+		constexpr uint64_t prime1{ 0x9E3779B185EBCA87ull };
+		constexpr uint64_t prime2{ 0xC2B2AE3D27D4EB4Full };
+		constexpr uint64_t prime3{ 0x165667B19E3779F9ull };
+		constexpr uint64_t prime4{ 0x85EBCA77C2B2AE63ull };
+		constexpr uint64_t prime5{ 0x27D4EB2F165667C5ull };
+
+		constexpr size_t stripeSize{ 32 };
+
+		uint64_t RotateLeft(uint64_t value, int bits)
+		{
+			return (value << bits) | (value >> (64 - bits));
+		}
+
+		uint64_t Read64(const std::byte* data)
+		{
+			uint64_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		uint32_t Read32(const std::byte* data)
+		{
+			uint32_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+		uint64_t Round(uint64_t accumulator, uint64_t input)
+		{
+			accumulator += input * prime2;
+			accumulator = RotateLeft(accumulator, 31);
+			return accumulator * prime1;
+		}
+		uint64_t MergeRound(uint64_t accumulator, uint64_t value)
+		{
+			accumulator ^= Round(0, value);
+			return accumulator * prime1 + prime4;
+		}
+
+		// Four independent lanes, so the multiplications of one stripe overlap
+		struct Lanes
+		{
+			explicit Lanes(uint64_t seed)
+				: v1(seed + prime1 + prime2), v2(seed + prime2), v3(seed), v4(seed - prime1)
+			{
+			}
+
+			// Consumes whole stripes only, returns how many bytes that was
+			size_t ConsumeStripes(const std::byte* data, size_t size)
+			{
+				const std::byte* end = data + size - size % stripeSize;
+				for (const std::byte* stripe = data; stripe != end; stripe += stripeSize)
+				{
+					v1 = Round(v1, Read64(stripe));
+					v2 = Round(v2, Read64(stripe + 8));
+					v3 = Round(v3, Read64(stripe + 16));
+					v4 = Round(v4, Read64(stripe + 24));
+				}
+				return size - size % stripeSize;
+			}
+
+			uint64_t Merge() const
+			{
+				uint64_t hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+				hash = MergeRound(hash, v1);
+				hash = MergeRound(hash, v2);
+				hash = MergeRound(hash, v3);
+				return MergeRound(hash, v4);
+			}
+
+			uint64_t v1;
+			uint64_t v2;
+			uint64_t v3;
+			uint64_t v4;
+		};
+
+		// 'tail' is what's left after the last whole stripe, less than 'stripeSize' bytes
+		uint64_t Finalize(uint64_t hash, const std::byte* tail, size_t tailSize)
+		{
+			for (; tailSize >= 8; tail += 8, tailSize -= 8)
+			{
+				hash ^= Round(0, Read64(tail));
+				hash = RotateLeft(hash, 27) * prime1 + prime4;
+			}
+			if (tailSize >= 4)
+			{
+				hash ^= static_cast<uint64_t>(Read32(tail)) * prime1;
+				hash = RotateLeft(hash, 23) * prime2 + prime3;
+				tail += 4;
+				tailSize -= 4;
+			}
+			for (; tailSize > 0; tail++, tailSize--)
+			{
+				hash ^= static_cast<uint64_t>(*tail) * prime5;
+				hash = RotateLeft(hash, 11) * prime1;
+			}
+
+			hash ^= hash >> 33;
+			hash *= prime2;
+			hash ^= hash >> 29;
+			hash *= prime3;
+			hash ^= hash >> 32;
+			return hash;
+		}
+
+		// Same result as 'ContentHasher::HashBytes' over everything passed to 'Update'
+		class StreamingHash
+		{
+		public:
+
+			explicit StreamingHash(uint64_t seed)
+				: lanes(seed), seed(seed)
+			{
+			}
+
+			void Update(const std::byte* data, size_t size)
+			{
+				totalSize += size;
+
+				if (pendingSize > 0)
+				{
+					size_t toCopy = std::min(size, stripeSize - pendingSize);
+					std::memcpy(pending + pendingSize, data, toCopy);
+					pendingSize += toCopy;
+					data += toCopy;
+					size -= toCopy;
+					if (pendingSize < stripeSize)
+						return;
+
+					lanes.ConsumeStripes(pending, stripeSize);
+					pendingSize = 0;
+				}
+
+				size_t consumed = lanes.ConsumeStripes(data, size);
+				std::memcpy(pending, data + consumed, size - consumed);
+				pendingSize = size - consumed;
+			}
+
+			uint64_t Digest() const
+			{
+				uint64_t hash = totalSize >= stripeSize ? lanes.Merge() : seed + prime5;
+				return Finalize(hash + totalSize, pending, pendingSize);
+			}
+
+		private:
+
+			Lanes lanes;
+			uint64_t seed;
+			uint64_t totalSize{ 0 };
+			std::byte pending[stripeSize];
+			size_t pendingSize{ 0 };
+		};
+
+		std::error_code LastErrorOr(std::errc fallback)
+		{
+			return errno != 0 ? std::error_code{ errno, std::generic_category() } : std::make_error_code(fallback);
+		}
+	}
+
+	bool ContentHasher::FileIdentity::operator==(const FileIdentity& other) const
+	{
+		return size == other.size && lastWriteTime == other.lastWriteTime && fileId == other.fileId;
+	}
+
+	ContentHasher::ContentHasher()
+	{
+	}
+	ContentHasher::~ContentHasher()
+	{
+	}
+
+	void ContentHasher::SetThreadCount(size_t threadCount)
+	{
+		this->threadCount = threadCount;
+		taskPool.reset();
+	}
+	size_t ContentHasher::GetThreadCount() const
+	{
+		return threadCount;
+	}
+
+	ContentHashStatistics ContentHasher::HashFiles(
+		const std::vector<std::filesystem::path>& absPaths,
+		std::vector<uint64_t>& hashes,
+		std::vector<std::error_code>& errors)
+	{
+		hashes.assign(absPaths.size(), 0);
+		errors.assign(absPaths.size(), std::error_code{});
+
+		ContentHashStatistics statistics{};
+		if (absPaths.empty())
+			return statistics;
+
+		std::vector<std::string> keys;
+		keys.reserve(absPaths.size());
+		for (const auto& absPath : absPaths)
+		{
+			keys.push_back(absPath.generic_string());
+		}
+
+		// The cache is only read while the workers run, it's updated on this thread once they're done
+		std::vector<FileIdentity> identities(absPaths.size());
+		std::vector<char> cached(absPaths.size(), 0);
+		std::vector<uint64_t> bytesRead(absPaths.size(), 0);
+
+		auto statFiles = [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+			{
+				identities[i] = QueryIdentity(absPaths[i], errors[i]);
+				if (errors[i])
+					continue;
+
+				auto entry = cache.find(keys[i]);
+				if (entry != cache.end() && entry->second.identity == identities[i])
+				{
+					hashes[i] = entry->second.hash;
+					cached[i] = 1;
+				}
+			}
+		};
+		auto hashFiles = [&](const Job* first, const Job* last, std::vector<std::byte>& buffer) {
+			for (const Job* job = first; job != last; job++)
+			{
+				hashes[job->index] = HashFile(absPaths[job->index], buffer, bytesRead[job->index], errors[job->index]);
+			}
+		};
+
+		std::vector<Job> jobs;
+		auto collectJobs = [&]() {
+			for (size_t i = 0; i < absPaths.size(); i++)
+			{
+				if (!errors[i] && !cached[i])
+					jobs.push_back(Job{ i, identities[i] });
+			}
+			// Largest first, so that the last task to finish is a short one
+			std::stable_sort(jobs.begin(), jobs.end(), [](const Job& job1, const Job& job2) {
+				return job1.identity.size > job2.identity.size;
+			});
+		};
+
+		if (absPaths.size() == 1)
+		{
+			// Not worth waking the workers up for
+			std::vector<std::byte> buffer;
+			statFiles(0, 1);
+			collectJobs();
+			hashFiles(jobs.data(), jobs.data() + jobs.size(), buffer);
+		}
+		else
+		{
+			if (!taskPool)
+				taskPool = std::make_unique<impl::TaskPool>(threadCount);
+
+			for (size_t first = 0; first < absPaths.size(); first += filesPerStatTask)
+			{
+				size_t last = std::min(first + filesPerStatTask, absPaths.size());
+				taskPool->Submit([&statFiles, first, last]() {
+					statFiles(first, last);
+				});
+			}
+			taskPool->Wait();
+
+			collectJobs();
+
+			// One buffer per worker, every worker only ever touches its own
+			std::vector<std::vector<std::byte>> buffers(taskPool->GetThreadCount());
+			for (size_t first = 0; first < jobs.size();)
+			{
+				size_t last = first + 1;
+				if (jobs[first].identity.size < mapThreshold)
+					last = std::min(first + smallFilesPerHashTask, jobs.size());
+
+				taskPool->Submit([this, &hashFiles, &buffers, first = jobs.data() + first, last = jobs.data() + last]() {
+					hashFiles(first, last, buffers[taskPool->GetCurrentWorkerIndex()]);
+				});
+				first = last;
+			}
+			taskPool->Wait();
+		}
+
+		for (size_t i = 0; i < absPaths.size(); i++)
+		{
+			if (cached[i])
+				statistics.cacheHits++;
+		}
+		for (const Job& job : jobs)
+		{
+			if (errors[job.index])
+				continue;
+
+			cache[std::move(keys[job.index])] = CacheEntry{ identities[job.index], hashes[job.index] };
+			statistics.filesHashed++;
+			statistics.bytesHashed += bytesRead[job.index];
+		}
+		return statistics;
+	}
+
+	void ContentHasher::HashFilePrefixes(
+		const std::vector<std::filesystem::path>& absPaths,
+		size_t prefixSize,
+		std::vector<uint64_t>& hashes,
+		std::vector<std::error_code>& errors)
+	{
+		hashes.assign(absPaths.size(), 0);
+		errors.assign(absPaths.size(), std::error_code{});
+
+		auto hashPrefixes = [&](size_t first, size_t last, std::vector<std::byte>& buffer) {
+			buffer.resize(prefixSize);
+			for (size_t i = first; i < last; i++)
+			{
+				hashes[i] = HashFilePrefix(absPaths[i], buffer, errors[i]);
+			}
+		};
+
+		if (absPaths.size() <= 1)
+		{
+			std::vector<std::byte> buffer;
+			hashPrefixes(0, absPaths.size(), buffer);
+			return;
+		}
+
+		if (!taskPool)
+			taskPool = std::make_unique<impl::TaskPool>(threadCount);
+
+		std::vector<std::vector<std::byte>> buffers(taskPool->GetThreadCount());
+		for (size_t first = 0; first < absPaths.size(); first += smallFilesPerHashTask)
+		{
+			size_t last = std::min(first + smallFilesPerHashTask, absPaths.size());
+			taskPool->Submit([this, &hashPrefixes, &buffers, first, last]() {
+				hashPrefixes(first, last, buffers[taskPool->GetCurrentWorkerIndex()]);
+			});
+		}
+		taskPool->Wait();
+	}
+
+	bool ContentHasher::SaveCache(const std::filesystem::path& cachePath) const
+	{
+		std::vector<HashCacheRecord> records;
+		records.reserve(cache.size());
+		std::string paths;
+		for (const auto& [path, entry] : cache)
+		{
+			HashCacheRecord record{};
+			record.size = entry.identity.size;
+			record.lastWriteTime = entry.identity.lastWriteTime;
+			record.fileId = entry.identity.fileId;
+			record.hash = entry.hash;
+			record.pathOffset = paths.size();
+			record.pathLength = static_cast<uint32_t>(path.size());
+			records.push_back(record);
+
+			paths += path;
+		}
+
+		HashCacheHeader header{};
+		std::memcpy(header.magic, hashCacheMagic, sizeof(header.magic));
+		header.version = hashCacheVersion;
+		header.recordSize = sizeof(HashCacheRecord);
+		header.entryCount = records.size();
+		header.pathsSize = paths.size();
+		header.timePeriodNum = std::filesystem::file_time_type::period::num;
+		header.timePeriodDen = std::filesystem::file_time_type::period::den;
+
+		// Written next to the destination first, so a crash can't leave a half-written cache behind
+		std::filesystem::path tempPath = cachePath;
+		tempPath += ".tmp";
+		{
+			std::ofstream cacheFile{ tempPath, std::ios::binary | std::ios::trunc };
+			if (!cacheFile)
+				return false;
+
+			cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			cacheFile.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(HashCacheRecord));
+			cacheFile.write(paths.data(), paths.size());
+			if (!cacheFile)
+				return false;
+		}
+
+		std::error_code error;
+		std::filesystem::rename(tempPath, cachePath, error);
+		return !error;
+	}
+	bool ContentHasher::LoadCache(const std::filesystem::path& cachePath)
+	{
+		impl::MappedFile cacheFile;
+		if (!cacheFile.Open(cachePath) || cacheFile.GetSize() < sizeof(HashCacheHeader))
+			return false;
+
+		HashCacheHeader header{};
+		std::memcpy(&header, cacheFile.GetData(), sizeof(header));
+		if (std::memcmp(header.magic, hashCacheMagic, sizeof(header.magic)) != 0 ||
+			header.version != hashCacheVersion ||
+			header.recordSize != sizeof(HashCacheRecord) ||
+			header.timePeriodNum != std::filesystem::file_time_type::period::num ||
+			header.timePeriodDen != std::filesystem::file_time_type::period::den)
+		{
+			return false;
+		}
+
+		if (!impl::HasFileLayout(cacheFile.GetSize(), sizeof(HashCacheHeader), header.entryCount, sizeof(HashCacheRecord), header.pathsSize))
+			return false;
+		uint64_t recordsSize = header.entryCount * sizeof(HashCacheRecord);
+
+		// The records that follow the header stay aligned
+		static_assert(sizeof(HashCacheHeader) == 48 && sizeof(HashCacheHeader) % alignof(HashCacheRecord) == 0);
+		const HashCacheRecord* records =
+			reinterpret_cast<const HashCacheRecord*>(cacheFile.GetData() + sizeof(HashCacheHeader));
+		const char* paths = reinterpret_cast<const char*>(cacheFile.GetData() + sizeof(HashCacheHeader) + recordsSize);
+
+		for (uint64_t i = 0; i < header.entryCount; i++)
+		{
+			if (records[i].pathOffset > header.pathsSize || records[i].pathLength > header.pathsSize - records[i].pathOffset)
+				return false;
+		}
+
+		cache.reserve(cache.size() + header.entryCount);
+		for (uint64_t i = 0; i < header.entryCount; i++)
+		{
+			const HashCacheRecord& record = records[i];
+			CacheEntry entry{};
+			entry.identity.size = record.size;
+			entry.identity.lastWriteTime = record.lastWriteTime;
+			entry.identity.fileId = record.fileId;
+			entry.hash = record.hash;
+			cache[std::string{ paths + record.pathOffset, record.pathLength }] = entry;
+		}
+		return true;
+	}
+	void ContentHasher::ClearCache()
+	{
+		cache.clear();
+	}
+	size_t ContentHasher::GetCacheSize() const
+	{
+		return cache.size();
+	}
+
+	uint64_t ContentHasher::HashBytes(const void* data, size_t size, uint64_t seed)
+	{
+		const std::byte* bytes = static_cast<const std::byte*>(data);
+
+		uint64_t hash = seed + prime5;
+		size_t consumed = 0;
+		if (size >= stripeSize)
+		{
+			Lanes lanes{ seed };
+			consumed = lanes.ConsumeStripes(bytes, size);
+			hash = lanes.Merge();
+		}
+		return Finalize(hash + size, bytes + consumed, size - consumed);
+	}
+
+	ContentHasher::FileIdentity ContentHasher::QueryIdentity(const std::filesystem::path& absPath, std::error_code& error)
+	{
+		FileIdentity identity{};
+#ifdef __linux__
+		struct stat status{};
+		if (stat(absPath.c_str(), &status) != 0)
+		{
+			error = std::error_code{ errno, std::generic_category() };
+			return FileIdentity{};
+		}
+
+		error.clear();
+		identity.size = static_cast<uint64_t>(status.st_size);
+		identity.lastWriteTime = LinuxDirectoryScanner::ToFileTime(status.st_mtim.tv_sec, status.st_mtim.tv_nsec)
+			.time_since_epoch().count();
+		identity.fileId = static_cast<uint64_t>(status.st_ino);
+#else
+		identity.size = std::filesystem::file_size(absPath, error);
+		if (!error)
+			identity.lastWriteTime = std::filesystem::last_write_time(absPath, error).time_since_epoch().count();
+		if (error)
+			return FileIdentity{};
+#endif
+		return identity;
+	}
+	uint64_t ContentHasher::HashFile(
+		const std::filesystem::path& absPath,
+		std::vector<std::byte>& buffer,
+		uint64_t& bytesRead,
+		std::error_code& error)
+	{
+		// Sizes come from before the file was opened, whatever is read now is what gets hashed
+		std::error_code sizeError;
+		uint64_t size = std::filesystem::file_size(absPath, sizeError);
+		if (!sizeError && size >= mapThreshold)
+		{
+			impl::MappedFile mappedFile;
+			if (mappedFile.Open(absPath))
+			{
+				bytesRead = mappedFile.GetSize();
+				return HashBytes(mappedFile.GetData(), mappedFile.GetSize());
+			}
+		}
+
+		errno = 0;
+		std::ifstream file{ absPath, std::ios::binary };
+		if (!file)
+		{
+			error = LastErrorOr(std::errc::io_error);
+			return 0;
+		}
+
+		buffer.resize(readBufferSize);
+		StreamingHash hash{ 0 };
+		bytesRead = 0;
+		while (file)
+		{
+			file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+			size_t count = static_cast<size_t>(file.gcount());
+			hash.Update(buffer.data(), count);
+			bytesRead += count;
+		}
+		if (file.bad())
+		{
+			error = LastErrorOr(std::errc::io_error);
+			return 0;
+		}
+		return hash.Digest();
+	}
+	uint64_t ContentHasher::HashFilePrefix(
+		const std::filesystem::path& absPath,
+		std::vector<std::byte>& buffer,
+		std::error_code& error)
+	{
+		errno = 0;
+		std::ifstream file{ absPath, std::ios::binary };
+		if (!file)
+		{
+			error = LastErrorOr(std::errc::io_error);
+			return 0;
+		}
+
+		file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+		if (file.bad())
+		{
+			error = LastErrorOr(std::errc::io_error);
+			return 0;
+		}
+		return HashBytes(buffer.data(), static_cast<size_t>(file.gcount()));
+	}
+}
\ No newline at end of file
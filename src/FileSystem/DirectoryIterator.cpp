@@ -0,0 +1,173 @@
+#include "../../include/FileSystem/DirectoryIterator.h"
+
+#include <cassert>
+#include <utility>
+
+namespace fs
+{
+	// RecursiveDirectoryIterator
+
+	RecursiveDirectoryIterator::RecursiveDirectoryIterator()
+	{
+	}
+	RecursiveDirectoryIterator::RecursiveDirectoryIterator(
+		const Directory& dir,
+		TraversalOrder order,
+		bool expand,
+		Filter filter)
+		: order(order), expand(expand), filter(std::move(filter))
+	{
+		// Deep enough for most trees, so the stack doesn't grow at all
+		stack.reserve(16);
+		PushLevel(dir, nullptr);
+		Advance();
+	}
+
+	DirectoryEntry& RecursiveDirectoryIterator::operator*() const
+	{
+		if (currentFile)
+			return **currentFile;
+		return **currentDir;
+	}
+	DirectoryEntry* RecursiveDirectoryIterator::operator->() const
+	{
+		return &**this;
+	}
+	RecursiveDirectoryIterator& RecursiveDirectoryIterator::operator++()
+	{
+		Advance();
+		return *this;
+	}
+
+	bool RecursiveDirectoryIterator::operator==(const RecursiveDirectoryIterator& other) const
+	{
+		return currentFile == other.currentFile && currentDir == other.currentDir;
+	}
+	bool RecursiveDirectoryIterator::operator!=(const RecursiveDirectoryIterator& other) const
+	{
+		return !(*this == other);
+	}
+
+	const std::shared_ptr<File>& RecursiveDirectoryIterator::GetFile() const
+	{
+		assert(currentFile && "The current entry isn't a file");
+		return *currentFile;
+	}
+	const std::shared_ptr<Directory>& RecursiveDirectoryIterator::GetDirectory() const
+	{
+		assert(currentDir && "The current entry isn't a directory");
+		return *currentDir;
+	}
+	std::shared_ptr<DirectoryEntry> RecursiveDirectoryIterator::GetEntry() const
+	{
+		if (currentFile)
+			return *currentFile;
+		return *currentDir;
+	}
+
+	size_t RecursiveDirectoryIterator::GetDepth() const
+	{
+		return currentDepth;
+	}
+
+	void RecursiveDirectoryIterator::SkipSubtree()
+	{
+		assert(order == TraversalOrder::PRE_ORDER && "Post-order has already walked the subtree");
+		enterCurrentDir = false;
+	}
+
+	void RecursiveDirectoryIterator::PushLevel(const Directory& dir, const std::shared_ptr<Directory>* dirEntry)
+	{
+		if (expand)
+			dir.ExpandIfNeeded();
+		stack.push_back(Level{ &dir, 0, dirEntry });
+	}
+
+	void RecursiveDirectoryIterator::Advance()
+	{
+		if (enterCurrentDir)
+		{
+			enterCurrentDir = false;
+			PushLevel(**currentDir, currentDir);
+		}
+
+		currentFile = nullptr;
+		currentDir = nullptr;
+
+		while (!stack.empty())
+		{
+			Level& level = stack.back();
+			const Directory::Files& files = level.dir->GetLoadedFiles();
+			const Directory::Directories& dirs = level.dir->GetLoadedDirectories();
+
+			if (level.nextIndex < files.size())
+			{
+				const std::shared_ptr<File>& file = files[level.nextIndex++];
+				if (Accept(*file))
+				{
+					currentFile = &file;
+					currentDepth = stack.size();
+					return;
+				}
+				continue;
+			}
+
+			size_t dirIndex = level.nextIndex - files.size();
+			if (dirIndex < dirs.size())
+			{
+				level.nextIndex++;
+				const std::shared_ptr<Directory>& dir = dirs[dirIndex];
+				if (order == TraversalOrder::POST_ORDER)
+				{
+					// Yielded when its level is popped
+					PushLevel(*dir, &dir);
+					continue;
+				}
+
+				if (Accept(*dir))
+				{
+					currentDir = &dir;
+					currentDepth = stack.size();
+					enterCurrentDir = true;
+					return;
+				}
+				PushLevel(*dir, &dir);
+				continue;
+			}
+
+			const std::shared_ptr<Directory>* finishedDir = level.dirEntry;
+			stack.pop_back();
+			if (order == TraversalOrder::POST_ORDER && finishedDir && Accept(**finishedDir))
+			{
+				currentDir = finishedDir;
+				currentDepth = stack.size();
+				return;
+			}
+		}
+	}
+
+	bool RecursiveDirectoryIterator::Accept(const DirectoryEntry& entry) const
+	{
+		return !filter || filter(entry);
+	}
+
+	// RecursiveDirectoryRange
+
+	RecursiveDirectoryRange::RecursiveDirectoryRange(
+		const Directory& dir,
+		TraversalOrder order,
+		bool expand,
+		RecursiveDirectoryIterator::Filter filter)
+		: dir(dir), order(order), expand(expand), filter(std::move(filter))
+	{
+	}
+
+	RecursiveDirectoryIterator RecursiveDirectoryRange::begin() const
+	{
+		return RecursiveDirectoryIterator{ dir, order, expand, filter };
+	}
+	RecursiveDirectoryIterator RecursiveDirectoryRange::end() const
+	{
+		return RecursiveDirectoryIterator{};
+	}
+}
\ No newline at end of file
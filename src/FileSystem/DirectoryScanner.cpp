@@ -0,0 +1,92 @@
+#include "../../include/FileSystem/DirectoryScanner.h"
+
+#ifdef __linux__
+#include "../../include/FileSystem/LinuxDirectoryScanner.h"
+#endif
+
+namespace fs
+{
+	void DirectoryScanner::SetBackend(DirectoryScannerBackend backend)
+	{
+		this->backend = backend;
+	}
+	DirectoryScannerBackend DirectoryScanner::GetBackend() const
+	{
+		return backend;
+	}
+
+	void DirectoryScanner::ScanDirectory(
+		const std::filesystem::path& dirAbsPath,
+		std::vector<ScannedEntry>& entries) const
+	{
+#ifdef __linux__
+		if (UseNativeBackend())
+		{
+			LinuxDirectoryScanner::ScanDirectory(dirAbsPath, entries);
+			return;
+		}
+#endif
+
+		for (const auto& entry : std::filesystem::directory_iterator{ dirAbsPath })
+		{
+			ScannedEntry scannedEntry{};
+			if (entry.is_regular_file())
+				scannedEntry.type = DirectoryEntryType::FILE;
+			else if (entry.is_directory())
+				scannedEntry.type = DirectoryEntryType::DIRECTORY;
+			else
+				continue;
+
+			std::error_code error;
+			scannedEntry.lastWriteTime = entry.last_write_time(error);
+			if (scannedEntry.type == DirectoryEntryType::FILE)
+			{
+				scannedEntry.size = entry.file_size(error);
+				if (error)
+					scannedEntry.size = 0;
+			}
+			scannedEntry.name = entry.path().filename().string();
+
+			entries.push_back(std::move(scannedEntry));
+		}
+	}
+
+	std::filesystem::file_time_type DirectoryScanner::GetLastWriteTime(
+		const std::filesystem::path& absPath,
+		std::error_code& error) const
+	{
+#ifdef __linux__
+		if (UseNativeBackend())
+			return LinuxDirectoryScanner::GetLastWriteTime(absPath, error);
+#endif
+
+		std::filesystem::file_time_type lastWriteTime = std::filesystem::last_write_time(absPath, error);
+		if (error)
+			return std::filesystem::file_time_type{};
+		return lastWriteTime;
+	}
+	EntryStatus DirectoryScanner::GetStatus(
+		const std::filesystem::path& absPath,
+		std::error_code& error) const
+	{
+#ifdef __linux__
+		if (UseNativeBackend())
+			return LinuxDirectoryScanner::GetStatus(absPath, error);
+#endif
+
+		EntryStatus status{};
+		std::filesystem::file_status fileStatus = std::filesystem::status(absPath, error);
+		if (!error)
+			status.lastWriteTime = std::filesystem::last_write_time(absPath, error);
+		if (!error && std::filesystem::is_regular_file(fileStatus))
+			status.size = std::filesystem::file_size(absPath, error);
+		if (error)
+			return EntryStatus{};
+		return status;
+	}
+
+	bool DirectoryScanner::UseNativeBackend() const
+	{
+		return backend == DirectoryScannerBackend::NATIVE;
+	}
+}
\ No newline at end of file
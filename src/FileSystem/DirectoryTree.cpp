@@ -1,11 +1,412 @@
 #include "../../include/FileSystem/DirectoryTree.h"
+#include "../../include/FileSystem/DirectoryIterator.h"
+#include "../../include/FileSystem/DuplicateFinder.h"
+#include "../../include/FileSystem/MappedFile.h"
+#include "../../include/FileSystem/NameSearchIndex.h"
+#include "../../include/FileSystem/TaskPool.h"
+#include "../../include/FileSystem/TreeSnapshot.h"
+#include "../../include/FileSystem/TreeVersion.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <fstream>
+#include <ratio>
+#include <string_view>
+#include <unordered_set>
 #include <utility>
 
 namespace fs
 {
+	constexpr size_t prefetchThreadCount{ 2 };
+	// Files of a directory are handed to 'ParallelDirectoryTreeProcessor' in tasks of at most this many
+	constexpr size_t processFileChunkSize{ 256 };
+	// Directories with more files than this are sorted by all of the threads together
+	constexpr size_t parallelSortThreshold{ 65536 };
+	// Smaller ones are handed to the threads in tasks of about this many entries, sorting a small directory
+	// costs much less than processing its files, so a task needs more of them to be worth submitting
+	constexpr size_t sortBatchEntryCount{ 1024 };
+
+	// Same order as 'Directory::GetDirEntriesRecursive', but lazily expanded directories are left as they are
+	static std::vector<std::shared_ptr<DirectoryEntry>> GetLoadedDirEntriesRecursive(const Directory& dir)
+	{
+		std::vector<std::shared_ptr<DirectoryEntry>> result;
+		RecursiveDirectoryIterator entry{ dir, TraversalOrder::PRE_ORDER, false }, end;
+		for (; entry != end; ++entry)
+		{
+			result.push_back(entry.GetEntry());
+		}
+		return result;
+	}
+
+	static void ProcessFilesParallel(
+		ParallelDirectoryTreeProcessor& processor,
+		const impl::TaskPool& pool,
+		const Directory& dir,
+		const std::filesystem::path& dirPath,
+		size_t first,
+		size_t last)
+	{
+		size_t workerIndex = pool.GetCurrentWorkerIndex();
+		const Directory::Files& files = dir.GetLoadedFiles();
+		for (size_t i = first; i < last; i++)
+		{
+			processor.ProcessFile(*files[i], dirPath / files[i]->GetNameRef(), workerIndex);
+		}
+	}
+	static void ProcessDirectoryParallel(
+		ParallelDirectoryTreeProcessor& processor,
+		impl::TaskPool& pool,
+		const Directory& dir,
+		const std::filesystem::path& dirPath)
+	{
+		// Subdirectories go first, so that idle workers have something to steal right away
+		for (const auto& subdir : dir.GetLoadedDirectories())
+		{
+			pool.Submit([&processor, &pool, subdir = subdir.get(), subdirPath = dirPath / subdir->GetNameRef()]() {
+				ProcessDirectoryParallel(processor, pool, *subdir, subdirPath);
+			});
+		}
+
+		size_t fileCount = dir.GetLoadedFiles().size();
+		for (size_t first = processFileChunkSize; first < fileCount; first += processFileChunkSize)
+		{
+			size_t last = std::min(first + processFileChunkSize, fileCount);
+			pool.Submit([&processor, &pool, &dir, dirPath, first, last]() {
+				ProcessFilesParallel(processor, pool, dir, dirPath, first, last);
+			});
+		}
+
+		processor.ProcessDirectory(dir, dirPath, pool.GetCurrentWorkerIndex());
+		ProcessFilesParallel(processor, pool, dir, dirPath, 0, std::min(processFileChunkSize, fileCount));
+	}
+
+	// ParallelDirectoryTreeProcessor
+
+	void ParallelDirectoryTreeProcessor::ProcessDirectory(const Directory&, const std::filesystem::path&, size_t)
+	{
+	}
+	void ParallelDirectoryTreeProcessor::ProcessFile(const File&, const std::filesystem::path&, size_t)
+	{
+	}
+
+	// DirectoryTreeEventListener
+
+	void DirectoryTreeEventListener::OnEntriesAdded(const std::vector<std::shared_ptr<DirectoryEntry>>& entries)
+	{
+		for (const auto& entry : entries)
+		{
+			if (entry->IsDirectory())
+				OnDirectoryAdded(std::static_pointer_cast<Directory>(entry));
+			else
+				OnFileAdded(std::static_pointer_cast<File>(entry));
+		}
+	}
+	void DirectoryTreeEventListener::OnEntriesRemoved(const std::vector<std::shared_ptr<DirectoryEntry>>& entries)
+	{
+		for (const auto& entry : entries)
+		{
+			if (entry->IsDirectory())
+				OnDirectoryRemoved(std::static_pointer_cast<Directory>(entry));
+			else
+				OnFileRemoved(std::static_pointer_cast<File>(entry));
+		}
+	}
+	void DirectoryTreeEventListener::OnEntriesPathChanged(
+		const std::vector<std::pair<std::shared_ptr<DirectoryEntry>, std::filesystem::path>>& entries)
+	{
+		for (const auto& [entry, oldPath] : entries)
+		{
+			if (entry->IsDirectory())
+				OnDirectoryPathChanged(std::static_pointer_cast<Directory>(entry), oldPath);
+			else
+				OnFilePathChanged(std::static_pointer_cast<File>(entry), oldPath);
+		}
+	}
+	void DirectoryTreeEventListener::OnSubtreePathChanged(
+		std::shared_ptr<Directory> dir,
+		const std::filesystem::path& oldPath)
+	{
+		OnEntriesPathChanged(GetSubtreeOldPaths(std::move(dir), oldPath));
+	}
+
+	std::vector<std::pair<std::shared_ptr<DirectoryEntry>, std::filesystem::path>> DirectoryTreeEventListener::GetSubtreeOldPaths(
+		std::shared_ptr<Directory> dir,
+		const std::filesystem::path& oldPath)
+	{
+		std::vector<std::pair<std::shared_ptr<DirectoryEntry>, std::filesystem::path>> entries;
+		entries.push_back({ dir, oldPath });
+
+		// Old paths of the directories on the way to the current entry, indexed by depth
+		std::vector<std::filesystem::path> oldDirPaths{ oldPath };
+
+		RecursiveDirectoryIterator entry{ *dir, TraversalOrder::PRE_ORDER, false }, end;
+		for (; entry != end; ++entry)
+		{
+			oldDirPaths.resize(entry.GetDepth());
+			std::filesystem::path oldEntryPath = oldDirPaths.back() / entry->GetNameRef();
+			if (entry->IsDirectory())
+				oldDirPaths.push_back(oldEntryPath);
+
+			entries.push_back({ entry.GetEntry(), std::move(oldEntryPath) });
+		}
+		return entries;
+	}
+
+	// VersionTracker
+
+	// Remembers which directories changed since the last published version, so that only they
+	// and their ancestors are copied into the next one. Everything else is shared with the previous version.
+	class DirectoryTree::VersionTracker : public DirectoryTreeEventListener
+	{
+	public:
+
+		VersionTracker(const DirectoryTree& tree)
+			: tree(tree)
+		{
+		}
+
+		void OnFileAdded(std::shared_ptr<File> file) override
+		{
+			MarkChanged(file->GetParentDirectory().get());
+		}
+		void OnDirectoryAdded(std::shared_ptr<Directory> dir) override
+		{
+			MarkChanged(dir.get());
+		}
+
+		// Removed entries are still attached to their parents when listeners are notified
+		void OnFileRemoved(std::shared_ptr<File> file) override
+		{
+			MarkChanged(file->GetParentDirectory().get());
+		}
+		void OnDirectoryRemoved(std::shared_ptr<Directory> dir) override
+		{
+			MarkChanged(dir->GetParentDirectory().get());
+
+			// Another directory may be allocated at the same address later on
+			publishedDirs.erase(dir.get());
+			changedDirs.erase(dir.get());
+		}
+
+		void OnFilePathChanged(std::shared_ptr<File> file, const std::filesystem::path& oldPath) override
+		{
+			MarkChanged(file->GetParentDirectory().get());
+			MarkChanged(tree.FindDirectory(oldPath.parent_path()).get());
+		}
+		void OnDirectoryPathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath) override
+		{
+			MarkChanged(dir.get());
+			MarkChanged(tree.FindDirectory(oldPath.parent_path()).get());
+		}
+		void OnSubtreePathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath) override
+		{
+			// Published entries only know their names, everything under the directory is shared as it is
+			OnDirectoryPathChanged(std::move(dir), oldPath);
+		}
+
+		void OnFileModified(std::shared_ptr<File> file) override
+		{
+			MarkChanged(file->GetParentDirectory().get());
+		}
+		void OnDirectoryModified(std::shared_ptr<Directory> dir) override
+		{
+			MarkChanged(dir.get());
+		}
+
+		// Forgets everything published so far, the next version is copied from scratch
+		void Reset()
+		{
+			publishedDirs.clear();
+			changedDirs.clear();
+		}
+
+		std::shared_ptr<const TreeVersionDirectory> PublishDirectory(const Directory& dir)
+		{
+			auto published = publishedDirs.find(&dir);
+			if (published != publishedDirs.end() && changedDirs.find(&dir) == changedDirs.end())
+				return published->second;
+
+			TreeVersionDirectory::Files files;
+			files.reserve(dir.GetLoadedFiles().size());
+			for (const auto& file : dir.GetLoadedFiles())
+			{
+				files.push_back(std::make_shared<const TreeVersionFile>(*file));
+			}
+
+			TreeVersionDirectory::Directories subdirs;
+			subdirs.reserve(dir.GetLoadedDirectories().size());
+			for (const auto& subdir : dir.GetLoadedDirectories())
+			{
+				subdirs.push_back(PublishDirectory(*subdir));
+			}
+
+			std::shared_ptr<const TreeVersionDirectory> publishedDir =
+				std::make_shared<const TreeVersionDirectory>(dir, std::move(files), std::move(subdirs));
+			publishedDirs[&dir] = publishedDir;
+			return publishedDir;
+		}
+		void ClearChanges()
+		{
+			changedDirs.clear();
+		}
+
+		// A changed directory is copied together with all of its ancestors, so they're marked right away while
+		// the parent links are still valid. The pointers are only used as keys, removed directories aren't touched again.
+		void MarkChanged(const Directory* dir)
+		{
+			while (dir && changedDirs.insert(dir).second)
+			{
+				dir = dir->GetParentDirectory().get();
+			}
+		}
+
+	private:
+
+		const DirectoryTree& tree;
+
+		std::unordered_map<const Directory*, std::shared_ptr<const TreeVersionDirectory>> publishedDirs;
+		std::unordered_set<const Directory*> changedDirs;
+	};
+
+	// ExtensionIndex
+
+	// Files grouped by extension. Every extension owns a dense array of its files, a removed file
+	// is replaced by the last one of its array, so both adding and removing cost the same no matter how many there are.
+	class DirectoryTree::ExtensionIndex : public DirectoryTreeEventListener
+	{
+	public:
+
+		void OnFileAdded(std::shared_ptr<File> file) override
+		{
+			Insert(std::move(file));
+		}
+		void OnDirectoryAdded(std::shared_ptr<Directory>) override
+		{
+		}
+
+		void OnFileRemoved(std::shared_ptr<File> file) override
+		{
+			Erase(*file);
+		}
+		void OnDirectoryRemoved(std::shared_ptr<Directory>) override
+		{
+		}
+
+		// Renaming may change the extension, moving never does
+		void OnFilePathChanged(std::shared_ptr<File> file, const std::filesystem::path&) override
+		{
+			auto position = positions.find(file.get());
+			if (position == positions.end())
+				return;
+
+			if (extensions[position->second.extension].extension != file->GetFileExtension())
+			{
+				Erase(*file);
+				Insert(std::move(file));
+			}
+		}
+		void OnDirectoryPathChanged(std::shared_ptr<Directory>, const std::filesystem::path&) override
+		{
+		}
+		void OnSubtreePathChanged(std::shared_ptr<Directory>, const std::filesystem::path&) override
+		{
+		}
+
+		void OnFileModified(std::shared_ptr<File>) override
+		{
+		}
+		void OnDirectoryModified(std::shared_ptr<Directory>) override
+		{
+		}
+
+		void Reset()
+		{
+			extensionIds.clear();
+			extensions.clear();
+			positions.clear();
+		}
+
+		const std::vector<std::shared_ptr<File>>* Find(const std::string& extension) const
+		{
+			auto id = extensionIds.find(extension);
+			if (id == extensionIds.end())
+				return nullptr;
+			return &extensions[id->second].files;
+		}
+
+	private:
+
+		struct Extension
+		{
+			std::string extension;
+			std::vector<std::shared_ptr<File>> files;
+		};
+
+		struct Position
+		{
+			uint32_t extension;
+			uint32_t index;
+		};
+
+		void Insert(std::shared_ptr<File> file)
+		{
+			std::string extension{ file->GetFileExtension() };
+			auto [id, inserted] = extensionIds.try_emplace(extension, static_cast<uint32_t>(extensions.size()));
+			if (inserted)
+				extensions.push_back(Extension{ std::move(extension), {} });
+
+			std::vector<std::shared_ptr<File>>& files = extensions[id->second].files;
+			if (!positions.try_emplace(file.get(), Position{ id->second, static_cast<uint32_t>(files.size()) }).second)
+				return;
+			files.push_back(std::move(file));
+		}
+		void Erase(const File& file)
+		{
+			auto position = positions.find(&file);
+			if (position == positions.end())
+				return;
+
+			// Extensions stay interned even once they have no files left
+			std::vector<std::shared_ptr<File>>& files = extensions[position->second.extension].files;
+			uint32_t index = position->second.index;
+			positions.erase(position);
+			if (index + 1 != files.size())
+			{
+				files[index] = std::move(files.back());
+				positions[files[index].get()].index = index;
+			}
+			files.pop_back();
+		}
+
+		std::unordered_map<std::string, uint32_t> extensionIds;
+		std::vector<Extension> extensions;
+		std::unordered_map<const File*, Position> positions;
+	};
+
+	DirectoryTree::UpdateScope::UpdateScope(DirectoryTree& tree)
+		: tree(tree), uncaughtExceptions(std::uncaught_exceptions())
+	{
+		tree.updateDepth++;
+	}
+	DirectoryTree::UpdateScope::~UpdateScope()
+	{
+		tree.updateDepth--;
+		// Nothing's published while an exception is on its way out
+		if (tree.updateDepth == 0 && std::uncaught_exceptions() == uncaughtExceptions)
+			tree.PublishChanges();
+	}
+
+	// DirectoryTree
+
+	DirectoryTree::DirectoryTree()
+	{
+	}
+	DirectoryTree::~DirectoryTree()
+	{
+	}
+
 	void DirectoryTree::AddDirTreeEventListener(DirectoryTreeEventListener* listener)
 	{
 		listeners.push_back(listener);
@@ -19,11 +420,30 @@ namespace fs
 
 	void DirectoryTree::BuildRootTree(const std::filesystem::path& rootDirAbsPath)
 	{
+		UpdateScope scope{ *this };
+		ResetTree();
+
 		this->rootDirAbsParentPath = rootDirAbsPath.parent_path();
 
 		// "Assets"
 		std::filesystem::path rootDirRelPath = rootDirAbsPath.filename();
-		rootDir = BuildTree(rootDirRelPath);
+		Directory::DirectoryEntries addedEntries;
+		if (lazyExpansion)
+		{
+			std::error_code error;
+			rootDir = CreateLazyDirectory(
+				rootDirRelPath,
+				scanner.GetLastWriteTime(rootDirAbsPath, error));
+		}
+		else if (buildThreadCount == 1)
+			rootDir = BuildTree(rootDirRelPath, addedEntries);
+		else
+			rootDir = BuildTreeParallel(rootDirRelPath, addedEntries);
+
+		NotifyEntriesAdded(addedEntries);
+		// Listeners aren't told about the root, but its name can be searched for as well
+		if (nameSearchIndex)
+			nameSearchIndex->OnDirectoryAdded(rootDir);
 
 		// TEST
 		// auto entries = rootDir->GetDirEntries();
@@ -34,20 +454,526 @@ namespace fs
 		// auto dirsRecursive = rootDir->GetDirectoriesRecursive();
 	}
 
+	void DirectoryTree::SetBuildThreadCount(size_t threadCount)
+	{
+		buildThreadCount = threadCount;
+	}
+	size_t DirectoryTree::GetBuildThreadCount() const
+	{
+		return buildThreadCount;
+	}
+
+	void DirectoryTree::SetScannerBackend(DirectoryScannerBackend backend)
+	{
+		scanner.SetBackend(backend);
+	}
+	DirectoryScannerBackend DirectoryTree::GetScannerBackend() const
+	{
+		return scanner.GetBackend();
+	}
+
+	void DirectoryTree::SetLazyExpansion(bool enabled)
+	{
+		lazyExpansion = enabled;
+	}
+	bool DirectoryTree::IsLazyExpansionEnabled() const
+	{
+		return lazyExpansion;
+	}
+	std::vector<std::pair<std::filesystem::path, std::error_code>> DirectoryTree::TakeExpansionErrors()
+	{
+		return std::exchange(expansionErrors, {});
+	}
+
+	void DirectoryTree::SetLazyPrefetch(bool enabled)
+	{
+		lazyPrefetch = enabled;
+		if (!enabled)
+		{
+			prefetchPool.reset();
+			prefetchedListings.clear();
+		}
+	}
+	bool DirectoryTree::IsLazyPrefetchEnabled() const
+	{
+		return lazyPrefetch;
+	}
+
+	void DirectoryTree::SetVersioning(bool enabled)
+	{
+		if (enabled == static_cast<bool>(versionTracker))
+			return;
+
+		if (enabled)
+		{
+			versionTracker = std::make_unique<VersionTracker>(*this);
+			AddDirTreeEventListener(versionTracker.get());
+			PublishChanges();
+		}
+		else
+		{
+			RemoveDirTreeEventListener(versionTracker.get());
+			versionTracker.reset();
+			std::atomic_store(&publishedVersion, std::shared_ptr<const TreeVersion>{});
+		}
+	}
+	bool DirectoryTree::IsVersioningEnabled() const
+	{
+		return static_cast<bool>(versionTracker);
+	}
+
+	std::shared_ptr<const TreeVersion> DirectoryTree::GetVersion() const
+	{
+		return std::atomic_load(&publishedVersion);
+	}
+	void DirectoryTree::PublishVersion()
+	{
+		if (!versionTracker)
+			return;
+
+		versionTracker->Reset();
+		PublishChanges();
+	}
+
+	void DirectoryTree::SetExtensionIndexing(bool enabled)
+	{
+		if (enabled == static_cast<bool>(extensionIndex))
+			return;
+
+		if (enabled)
+		{
+			extensionIndex = std::make_unique<ExtensionIndex>();
+			AddDirTreeEventListener(extensionIndex.get());
+			if (rootDir)
+				extensionIndex->OnEntriesAdded(GetLoadedDirEntriesRecursive(*rootDir));
+		}
+		else
+		{
+			RemoveDirTreeEventListener(extensionIndex.get());
+			extensionIndex.reset();
+		}
+	}
+	bool DirectoryTree::IsExtensionIndexingEnabled() const
+	{
+		return static_cast<bool>(extensionIndex);
+	}
+
+	const std::vector<std::shared_ptr<File>>& DirectoryTree::GetFilesWithExtension(const std::string& extension) const
+	{
+		static const std::vector<std::shared_ptr<File>> noFiles;
+
+		const std::vector<std::shared_ptr<File>>* files = extensionIndex ? extensionIndex->Find(extension) : nullptr;
+		return files ? *files : noFiles;
+	}
+	size_t DirectoryTree::GetFileCountWithExtension(const std::string& extension) const
+	{
+		return GetFilesWithExtension(extension).size();
+	}
+
+	void DirectoryTree::SetNameSearchIndexing(bool enabled)
+	{
+		if (enabled == static_cast<bool>(nameSearchIndex))
+			return;
+
+		if (enabled)
+		{
+			nameSearchIndex = std::make_unique<NameSearchIndex>();
+			AddDirTreeEventListener(nameSearchIndex.get());
+			if (rootDir)
+			{
+				// The root's name can be searched for as well
+				Directory::DirectoryEntries entries = GetLoadedDirEntriesRecursive(*rootDir);
+				entries.insert(entries.begin(), rootDir);
+				nameSearchIndex->OnEntriesAdded(entries);
+			}
+		}
+		else
+		{
+			RemoveDirTreeEventListener(nameSearchIndex.get());
+			nameSearchIndex.reset();
+		}
+	}
+	bool DirectoryTree::IsNameSearchIndexingEnabled() const
+	{
+		return static_cast<bool>(nameSearchIndex);
+	}
+	const NameSearchIndex* DirectoryTree::GetNameSearchIndex() const
+	{
+		return nameSearchIndex.get();
+	}
+
+	void DirectoryTree::SetContentHashing(bool enabled)
+	{
+		if (enabled == static_cast<bool>(contentHasher))
+			return;
+
+		if (enabled)
+		{
+			contentHasher = std::make_unique<ContentHasher>();
+			return;
+		}
+
+		contentHasher.reset();
+		if (!rootDir)
+			return;
+
+		// They wouldn't be kept up to date anymore
+		RecursiveDirectoryIterator entry{ *rootDir, TraversalOrder::PRE_ORDER, false }, end;
+		for (; entry != end; ++entry)
+		{
+			if (entry->IsFile())
+				std::static_pointer_cast<File>(entry.GetEntry())->ClearContentHash();
+		}
+	}
+	bool DirectoryTree::IsContentHashingEnabled() const
+	{
+		return static_cast<bool>(contentHasher);
+	}
+	ContentHasher* DirectoryTree::GetContentHasher()
+	{
+		return contentHasher.get();
+	}
+	std::vector<std::pair<std::filesystem::path, std::error_code>> DirectoryTree::HashFileContents()
+	{
+		std::vector<std::pair<std::filesystem::path, std::error_code>> failedEntries;
+		if (!contentHasher || !rootDir)
+			return failedEntries;
+
+		std::vector<std::shared_ptr<File>> files;
+		std::vector<std::filesystem::path> absPaths;
+		RecursiveDirectoryIterator entry{ *rootDir, TraversalOrder::PRE_ORDER, false }, end;
+		for (; entry != end; ++entry)
+		{
+			if (!entry->IsFile())
+				continue;
+
+			std::shared_ptr<File> file = std::static_pointer_cast<File>(entry.GetEntry());
+			if (file->HasContentHash())
+				continue;
+
+			absPaths.push_back(rootDirAbsParentPath / file->GetPath());
+			files.push_back(std::move(file));
+		}
+
+		std::vector<uint64_t> hashes;
+		std::vector<std::error_code> errors;
+		contentHasher->HashFiles(absPaths, hashes, errors);
+
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			if (errors[i])
+				failedEntries.push_back({ files[i]->GetPath(), errors[i] });
+			else
+				files[i]->SetContentHash(hashes[i]);
+		}
+		return failedEntries;
+	}
+
+	void DirectoryTree::SetDuplicateDetection(bool enabled)
+	{
+		if (enabled == static_cast<bool>(duplicateFinder))
+			return;
+
+		if (enabled)
+		{
+			duplicateFinder = std::make_unique<DuplicateFinder>();
+			AddDirTreeEventListener(duplicateFinder.get());
+			if (rootDir)
+				duplicateFinder->OnEntriesAdded(GetLoadedDirEntriesRecursive(*rootDir));
+		}
+		else
+		{
+			RemoveDirTreeEventListener(duplicateFinder.get());
+			duplicateFinder.reset();
+		}
+	}
+	bool DirectoryTree::IsDuplicateDetectionEnabled() const
+	{
+		return static_cast<bool>(duplicateFinder);
+	}
+	DuplicateFinder* DirectoryTree::GetDuplicateFinder()
+	{
+		return duplicateFinder.get();
+	}
+	std::vector<std::pair<std::filesystem::path, std::error_code>> DirectoryTree::UpdateDuplicates()
+	{
+		if (!duplicateFinder)
+			return {};
+
+		return duplicateFinder->Update(rootDirAbsParentPath);
+	}
+
+	void DirectoryTree::SetSortingType(DirEntrySortType sortType, size_t threadCount)
+	{
+		UpdateScope scope{ *this };
+
+		this->sortType = sortType;
+		if (!rootDir)
+			return;
+
+		std::vector<Directory*> dirs;
+		std::vector<Directory*> largeDirs;
+		RecursiveDirectoryIterator entry{ *rootDir, TraversalOrder::PRE_ORDER, false }, end;
+		dirs.push_back(rootDir.get());
+		for (; entry != end; ++entry)
+		{
+			if (entry->IsDirectory())
+				dirs.push_back(static_cast<Directory*>(&*entry));
+		}
+
+		impl::TaskPool pool{ threadCount };
+
+		// Small directories are handed out in batches of about 'sortBatchEntryCount' entries
+		std::vector<Directory*> batch;
+		size_t batchEntryCount = 0;
+		auto submitBatch = [&pool, &batch, &batchEntryCount, sortType]() {
+			pool.Submit([batch = std::move(batch), sortType]() {
+				for (Directory* dir : batch)
+				{
+					dir->SetSortingType(sortType);
+				}
+			});
+			batch.clear();
+			batchEntryCount = 0;
+		};
+
+		for (Directory* dir : dirs)
+		{
+			if (versionTracker)
+				versionTracker->MarkChanged(dir);
+
+			if (dir->files.size() > parallelSortThreshold && pool.GetThreadCount() > 1)
+			{
+				largeDirs.push_back(dir);
+				continue;
+			}
+
+			batch.push_back(dir);
+			batchEntryCount += dir->files.size() + dir->directories.size() + 1;
+			if (batchEntryCount >= sortBatchEntryCount)
+				submitBatch();
+		}
+		if (!batch.empty())
+			submitBatch();
+		pool.Wait();
+
+		// One after another, each of them keeps all of the workers busy
+		for (Directory* dir : largeDirs)
+		{
+			Directory::Files files = std::move(dir->files);
+			dir->files.clear();
+			dir->SetSortingType(sortType);
+			dir->files = std::move(files);
+
+			SortFilesParallel(*dir, pool);
+		}
+	}
+	DirEntrySortType DirectoryTree::GetSortingType() const
+	{
+		return sortType;
+	}
+
 	void DirectoryTree::ClearTree()
 	{
+		UpdateScope scope{ *this };
+
 		// TODO
 		// Don't forget to delete all the entries and notify listeners
 		// about each one of them!
+		ResetTree();
+	}
+
+	void DirectoryTree::ResetTree()
+	{
+		if (versionTracker)
+			versionTracker->Reset();
+		if (extensionIndex)
+			extensionIndex->Reset();
+		if (nameSearchIndex)
+			nameSearchIndex->Clear();
+		if (duplicateFinder)
+			duplicateFinder->Clear();
+
+		// Listings still being prefetched are dropped when they finish
+		{
+			std::lock_guard lock{ prefetchMutex };
+			prefetchedListings.clear();
+		}
+		expansionErrors.clear();
+		modificationErrors.clear();
+
 		rootDir.reset();
 	}
 
+	bool DirectoryTree::SaveSnapshot(const std::filesystem::path& snapshotPath) const
+	{
+		if (!rootDir)
+			return false;
+
+		std::vector<TreeSnapshotRecord> records;
+		std::string names;
+
+		auto addRecord = [&records, &names](
+			const DirectoryEntry& entry, uint32_t parentIndex, DirEntrySortType sortType, uint16_t flags = 0)
+		{
+			std::string_view name = entry.GetNameRef();
+
+			TreeSnapshotRecord record{};
+			record.lastWriteTime = static_cast<int64_t>(entry.GetLastWriteTime().time_since_epoch().count());
+			record.size = entry.IsFile() ? static_cast<const File&>(entry).GetSize() : 0;
+			record.parentIndex = parentIndex;
+			record.nameOffset = static_cast<uint32_t>(names.size());
+			record.nameLength = static_cast<uint32_t>(name.size());
+			record.type = static_cast<uint8_t>(entry.GetDirectoryEntryType());
+			record.sortType = static_cast<uint8_t>(sortType);
+			record.flags = flags;
+			records.push_back(record);
+
+			names += name;
+			return static_cast<uint32_t>(records.size() - 1);
+		};
+
+		auto dirFlags = [](const Directory& dir) -> uint16_t {
+			return dir.IsExpanded() ? 0 : treeSnapshotUnexpandedFlag;
+		};
+
+		// Pre-order: a directory, then its files, then its subdirectories.
+		// Only what's loaded is saved, unexpanded directories don't have any entries yet.
+		std::vector<std::pair<std::shared_ptr<Directory>, uint32_t>> dirsToVisit;
+		dirsToVisit.push_back({ rootDir, addRecord(*rootDir, 0, rootDir->GetSortingType(), dirFlags(*rootDir)) });
+		while (!dirsToVisit.empty())
+		{
+			auto [dir, dirIndex] = dirsToVisit.back();
+			dirsToVisit.pop_back();
+
+			for (const auto& file : dir->GetLoadedFiles())
+			{
+				addRecord(*file, dirIndex, DirEntrySortType::ALPHABETICAL_L_TO_H);
+			}
+			for (const auto& subdir : dir->GetLoadedDirectories())
+			{
+				dirsToVisit.push_back({ subdir, addRecord(*subdir, dirIndex, subdir->GetSortingType(), dirFlags(*subdir)) });
+			}
+		}
+
+		TreeSnapshotHeader header{};
+		std::memcpy(header.magic, treeSnapshotMagic, sizeof(header.magic));
+		header.version = treeSnapshotVersion;
+		header.recordSize = sizeof(TreeSnapshotRecord);
+		header.entryCount = records.size();
+		header.namesSize = names.size();
+		header.timePeriodNum = std::filesystem::file_time_type::period::num;
+		header.timePeriodDen = std::filesystem::file_time_type::period::den;
+
+		// Written next to the destination first, so a crash can't leave a half-written snapshot behind
+		std::filesystem::path tempPath = snapshotPath;
+		tempPath += ".tmp";
+		std::error_code error;
+		{
+			std::ofstream snapshotFile{ tempPath, std::ios::binary | std::ios::trunc };
+			if (!snapshotFile)
+				return false;
+
+			snapshotFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			snapshotFile.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(TreeSnapshotRecord));
+			snapshotFile.write(names.data(), names.size());
+			snapshotFile.close();
+			if (!snapshotFile)
+			{
+				std::filesystem::remove(tempPath, error);
+				return false;
+			}
+		}
+
+		std::filesystem::rename(tempPath, snapshotPath, error);
+		if (error)
+		{
+			std::error_code removeError;
+			std::filesystem::remove(tempPath, removeError);
+			return false;
+		}
+		return true;
+	}
+	bool DirectoryTree::LoadSnapshot(const std::filesystem::path& snapshotPath, const std::filesystem::path& rootDirAbsPath)
+	{
+		UpdateScope scope{ *this };
+
+		impl::MappedFile snapshotFile;
+		if (!snapshotFile.Open(snapshotPath))
+			return false;
+
+		std::vector<std::shared_ptr<Directory>> unexpandedDirs;
+		if (!BuildTreeFromSnapshot(snapshotFile.GetData(), snapshotFile.GetSize(), rootDirAbsPath.filename(), unexpandedDirs))
+			return false;
+
+		snapshotFile.Close();
+
+		this->rootDirAbsParentPath = rootDirAbsPath.parent_path();
+
+		// Saved by a tree with lazy expansion, but this one wants everything loaded
+		if (!lazyExpansion)
+		{
+			for (const auto& dir : unexpandedDirs)
+			{
+				dir->Expand();
+			}
+		}
+
+		Rescan();
+		return true;
+	}
+
+	RescanStatistics DirectoryTree::Rescan()
+	{
+		if (!rootDir)
+			return RescanStatistics{};
+		return Rescan(rootDir->GetPath());
+	}
+	RescanStatistics DirectoryTree::Rescan(const std::filesystem::path& dirPath)
+	{
+		UpdateScope scope{ *this };
+
+		RescanStatistics statistics{};
+
+		// An unexpanded directory has nothing to reconcile, it's listed from scratch when it's expanded
+		std::shared_ptr<Directory> dir = GetExpandedDirectory(dirPath);
+		if (!dir)
+			return statistics;
+
+		std::error_code error;
+		std::filesystem::file_time_type lastWriteTime =
+			scanner.GetLastWriteTime(rootDirAbsParentPath / dir->GetPath(), error);
+		statistics.entriesStated++;
+		if (error)
+			return statistics;
+
+		bool dirChanged = lastWriteTime != dir->GetLastWriteTime();
+		if (dirChanged)
+		{
+			dir->SetLastWriteTime(lastWriteTime);
+			NotifyDirectoryModified(dir);
+		}
+
+		ReconcileDirectories({ { dir, dirChanged } }, statistics);
+		return statistics;
+	}
+
 	void DirectoryTree::AddNewFile(const std::filesystem::path& filePath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path parentDirRelPath = filePath.parent_path();
 
-		std::shared_ptr<Directory> parentDir = GetDirectory(parentDirRelPath);
-		assert(parentDir && "Can't add a file into a directory that doesn't exist");
+		std::shared_ptr<Directory> parentDir = GetExpandedDirectory(parentDirRelPath);
+		if (!parentDir)
+		{
+			assert(lazyExpansion && "Can't add a file into a directory that doesn't exist");
+			return;
+		}
+
+		// Already there if the parent was expanded after the file had been created
+		if (parentDir->FileExists(filePath.filename().generic_string()))
+			return;
 
 		//std::shared_ptr<File> newFile = std::make_shared<File>(
 		//	filePath,
@@ -60,24 +986,54 @@ namespace fs
 	}
 	void DirectoryTree::AddNewDirectory(const std::filesystem::path& dirPath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path parentDirRelPath = dirPath.parent_path();
 
-		std::shared_ptr<Directory> parentDir = GetDirectory(parentDirRelPath);
-		assert(parentDir && "Can't add a directory into a directory that doesn't exist");
+		std::shared_ptr<Directory> parentDir = GetExpandedDirectory(parentDirRelPath);
+		if (!parentDir)
+		{
+			assert(lazyExpansion && "Can't add a directory into a directory that doesn't exist");
+			return;
+		}
+
+		// Already there if the parent was expanded after the directory had been created
+		if (parentDir->DirectoryExists(dirPath.filename().generic_string()))
+			return;
 
-		std::shared_ptr<Directory> newDir = BuildTree(dirPath);
+		std::shared_ptr<Directory> newDir;
+		Directory::DirectoryEntries addedEntries;
+		if (lazyExpansion)
+		{
+			std::error_code error;
+			newDir = CreateLazyDirectory(
+				dirPath,
+				scanner.GetLastWriteTime(rootDirAbsParentPath / dirPath, error));
+		}
+		else if (buildThreadCount == 1)
+			newDir = BuildTree(dirPath, addedEntries);
+		else
+			newDir = BuildTreeParallel(dirPath, addedEntries);
 
 		Directory::AddDirectoryToDirectory(parentDir, newDir);
 
-		NotifyDirectoryAdded(newDir);
+		// The contents first, the directory itself last
+		addedEntries.push_back(newDir);
+		NotifyEntriesAdded(addedEntries);
 	}
 
 	void DirectoryTree::RemoveFile(const std::filesystem::path& filePath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path parentDirRelPath = filePath.parent_path();
 
-		std::shared_ptr<Directory> parentDir = GetDirectory(parentDirRelPath);
-		assert(parentDir && "Can't remove a file from a directory that doesn't exist");
+		std::shared_ptr<Directory> parentDir = GetExpandedDirectory(parentDirRelPath);
+		if (!parentDir)
+		{
+			assert(lazyExpansion && "Can't remove a file from a directory that doesn't exist");
+			return;
+		}
 
 		std::shared_ptr<File> fileToDelete =
 			parentDir->GetFile(filePath.filename().generic_string());
@@ -99,10 +1055,16 @@ namespace fs
 	}
 	void DirectoryTree::RemoveDirectory(const std::filesystem::path& dirPath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path parentDirRelPath = dirPath.parent_path();
 
-		std::shared_ptr<Directory> parentDir = GetDirectory(parentDirRelPath);
-		assert(parentDir && "Can't remove a directory from a directory that doesn't exist");
+		std::shared_ptr<Directory> parentDir = GetExpandedDirectory(parentDirRelPath);
+		if (!parentDir)
+		{
+			assert(lazyExpansion && "Can't remove a directory from a directory that doesn't exist");
+			return;
+		}
 
 		std::shared_ptr<Directory> dirToDelete =
 			parentDir->GetDirectory(dirPath.filename().generic_string());
@@ -118,31 +1080,37 @@ namespace fs
 		// If we want the opposite result, when we'd like to be notified about these entities
 		// with new information (after the delete operation), then change the order of operations.
 
-		for (auto& dirEntity : dirToDelete->GetDirEntriesRecursive())
-		{
-			if (dirEntity->IsDirectory())
-			{
-				directories.erase(dirEntity->GetPath());
-				NotifyDirectoryRemoved(std::static_pointer_cast<Directory>(dirEntity));
-			}
-			else
-			{
-				NotifyFileRemoved(std::static_pointer_cast<File>(dirEntity));
-			}
-		}
+		Directory::DirectoryEntries removedEntries = GetLoadedDirEntriesRecursive(*dirToDelete);
+		removedEntries.push_back(dirToDelete);
+
+		InvalidatePrefetchedListings(dirToDelete->GetPath());
+
+		NotifyEntriesRemoved(removedEntries);
 
 		parentDir->DeleteDirectory(dirToDelete);
 	}
 
 	void DirectoryTree::MoveFile(const std::filesystem::path& oldPath, const std::filesystem::path& newPath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path oldPathParentPath = oldPath.parent_path();
 		std::filesystem::path newPathParentPath = newPath.parent_path();
 
-		std::shared_ptr<Directory> oldPathParentDir = GetDirectory(oldPathParentPath);
-		std::shared_ptr<Directory> newPathParentDir = GetDirectory(newPathParentPath);
+		std::shared_ptr<Directory> oldPathParentDir = GetExpandedDirectory(oldPathParentPath);
+		std::shared_ptr<Directory> newPathParentDir = GetExpandedDirectory(newPathParentPath);
+
+		if (!oldPathParentDir || !newPathParentDir)
+		{
+			assert(lazyExpansion && "The old or new directory doesn't exist");
 
-		assert(oldPathParentDir && newPathParentDir && "The old or new directory doesn't exist");
+			// Moved into or out of the expanded part of the tree
+			if (oldPathParentDir)
+				RemoveFile(oldPath);
+			else if (newPathParentDir)
+				AddNewFile(newPath);
+			return;
+		}
 
 		std::shared_ptr<File> fileToMove = oldPathParentDir->GetFile(oldPath.filename().generic_string());
 		
@@ -155,13 +1123,25 @@ namespace fs
 	}
 	void DirectoryTree::MoveDirectory(const std::filesystem::path& oldPath, const std::filesystem::path& newPath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path oldPathParentPath = oldPath.parent_path();
 		std::filesystem::path newPathParentPath = newPath.parent_path();
 
-		std::shared_ptr<Directory> oldPathParentDir = GetDirectory(oldPathParentPath);
-		std::shared_ptr<Directory> newPathParentDir = GetDirectory(newPathParentPath);
+		std::shared_ptr<Directory> oldPathParentDir = GetExpandedDirectory(oldPathParentPath);
+		std::shared_ptr<Directory> newPathParentDir = GetExpandedDirectory(newPathParentPath);
 
-		assert(oldPathParentDir && newPathParentDir && "The old or new directory doesn't exist");
+		if (!oldPathParentDir || !newPathParentDir)
+		{
+			assert(lazyExpansion && "The old or new directory doesn't exist");
+
+			// Moved into or out of the expanded part of the tree
+			if (oldPathParentDir)
+				RemoveDirectory(oldPath);
+			else if (newPathParentDir)
+				AddNewDirectory(newPath);
+			return;
+		}
 
 		std::shared_ptr<Directory> directoryToMove = oldPathParentDir->GetDirectory(oldPath.filename().generic_string());
 
@@ -169,25 +1149,50 @@ namespace fs
 
 		// ResolveChangedPathDirectory(newPath, std::filesystem::path{}, directoryToMove);
 
-		EntityPathPairs entities = ConstructDirEntityPathPairs(directoryToMove);
+		std::filesystem::path oldDirPath = directoryToMove->GetPath();
 
+		// Only the directory itself is relinked, nothing under it is touched
 		oldPathParentDir->DeleteDirectory(directoryToMove);
 		Directory::AddDirectoryToDirectory(newPathParentDir, directoryToMove);
 
-		ProcessPathChanges(entities);
+		ProcessSubtreePathChange(directoryToMove, oldDirPath);
 	}
 
 	void DirectoryTree::ProcessModifiedFile(const std::filesystem::path& oldPath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path oldPathParentPath = oldPath.parent_path();
 
-		std::shared_ptr<Directory> oldPathParentDir = GetDirectory(oldPathParentPath);
-		assert(oldPathParentDir && "The directory where the modified file should be doesn't exist");
+		std::shared_ptr<Directory> oldPathParentDir = GetExpandedDirectory(oldPathParentPath);
+		if (!oldPathParentDir)
+		{
+			assert(lazyExpansion && "The directory where the modified file should be doesn't exist");
+			return;
+		}
 
 		std::shared_ptr<File> modifiedFile = oldPathParentDir->GetFile(oldPath.filename().generic_string());
 		assert(modifiedFile && "Modified file doesn't exist");
 
-		modifiedFile->UpdateStatus(rootDirAbsParentPath);
+		if (contentHasher)
+		{
+			std::vector<std::pair<std::filesystem::path, std::error_code>> failedEntries = ProcessModifiedFilesByContent({ modifiedFile });
+			modificationErrors.insert(modificationErrors.end(), failedEntries.begin(), failedEntries.end());
+			return;
+		}
+
+		// The size comes with the same query, unlike in 'DirectoryEntry::UpdateStatus'
+		std::filesystem::path absPath = rootDirAbsParentPath / modifiedFile->GetPath();
+		std::error_code error;
+		EntryStatus status = scanner.GetStatus(absPath, error);
+		if (error)
+		{
+			modificationErrors.push_back({ modifiedFile->GetPath(), error });
+			return;
+		}
+
+		modifiedFile->UpdateStatus(status.lastWriteTime);
+		modifiedFile->SetSize(status.size);
 		if (modifiedFile->Modified())
 		{
 			NotifyFileModified(modifiedFile);
@@ -195,10 +1200,19 @@ namespace fs
 	}
 	void DirectoryTree::ProcessModifiedDirectory(const std::filesystem::path& oldPath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path oldPathParentPath = oldPath.parent_path();
 
-		std::shared_ptr<Directory> oldPathParentDir = GetDirectory(oldPathParentPath);
-		assert(oldPathParentDir && "The directory where the modified directory should be doesn't exist");
+		// Its entries changed, so a prefetched listing is out of date
+		InvalidatePrefetchedListing(oldPath);
+
+		std::shared_ptr<Directory> oldPathParentDir = GetExpandedDirectory(oldPathParentPath);
+		if (!oldPathParentDir)
+		{
+			assert(lazyExpansion && "The directory where the modified directory should be doesn't exist");
+			return;
+		}
 
 		std::shared_ptr<Directory> modifiedDirectory = oldPathParentDir->GetDirectory(oldPath.filename().generic_string());
 		assert(modifiedDirectory && "Modified directory doesn't exist");
@@ -210,15 +1224,93 @@ namespace fs
 		}
 	}
 
+	std::vector<std::pair<std::filesystem::path, std::error_code>> DirectoryTree::ProcessModifiedFiles(
+		const std::vector<std::filesystem::path>& oldPaths)
+	{
+		UpdateScope scope{ *this };
+
+		std::vector<std::shared_ptr<DirectoryEntry>> modifiedFiles;
+		modifiedFiles.reserve(oldPaths.size());
+		for (const auto& oldPath : oldPaths)
+		{
+			std::shared_ptr<Directory> oldPathParentDir = GetExpandedDirectory(oldPath.parent_path());
+			if (!oldPathParentDir)
+				continue;
+
+			std::shared_ptr<File> modifiedFile = oldPathParentDir->GetFile(oldPath.filename().generic_string());
+			if (modifiedFile)
+				modifiedFiles.push_back(modifiedFile);
+		}
+
+		if (contentHasher)
+			return ProcessModifiedFilesByContent(modifiedFiles);
+
+		std::vector<std::error_code> errors = statusRefresher.RefreshStatus(modifiedFiles, rootDirAbsParentPath);
+
+		std::vector<std::pair<std::filesystem::path, std::error_code>> failedEntries;
+		for (size_t i = 0; i < modifiedFiles.size(); i++)
+		{
+			if (errors[i])
+				failedEntries.push_back({ modifiedFiles[i]->GetPath(), errors[i] });
+			else if (modifiedFiles[i]->Modified())
+				NotifyFileModified(std::static_pointer_cast<File>(modifiedFiles[i]));
+		}
+		return failedEntries;
+	}
+	std::vector<std::pair<std::filesystem::path, std::error_code>> DirectoryTree::ProcessModifiedDirectories(
+		const std::vector<std::filesystem::path>& oldPaths)
+	{
+		UpdateScope scope{ *this };
+
+		std::vector<std::shared_ptr<DirectoryEntry>> modifiedDirectories;
+		modifiedDirectories.reserve(oldPaths.size());
+		for (const auto& oldPath : oldPaths)
+		{
+			InvalidatePrefetchedListing(oldPath);
+
+			std::shared_ptr<Directory> modifiedDirectory = FindDirectory(oldPath);
+			if (modifiedDirectory)
+				modifiedDirectories.push_back(modifiedDirectory);
+		}
+
+		std::vector<std::error_code> errors = statusRefresher.RefreshStatus(modifiedDirectories, rootDirAbsParentPath);
+
+		std::vector<std::pair<std::filesystem::path, std::error_code>> failedEntries;
+		for (size_t i = 0; i < modifiedDirectories.size(); i++)
+		{
+			if (errors[i])
+				failedEntries.push_back({ modifiedDirectories[i]->GetPath(), errors[i] });
+			else if (modifiedDirectories[i]->Modified())
+				NotifyDirectoryModified(std::static_pointer_cast<Directory>(modifiedDirectories[i]));
+		}
+		return failedEntries;
+	}
+	std::vector<std::pair<std::filesystem::path, std::error_code>> DirectoryTree::TakeModificationErrors()
+	{
+		return std::exchange(modificationErrors, {});
+	}
+
 	void DirectoryTree::RenameFile(const std::filesystem::path& oldPath, const std::filesystem::path& newPath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path oldPathParentPath = oldPath.parent_path();
 		std::filesystem::path newPathParentPath = newPath.parent_path();
 
-		std::shared_ptr<Directory> oldPathParentDir = GetDirectory(oldPathParentPath);
-		std::shared_ptr<Directory> newPathParentDir = GetDirectory(newPathParentPath);
+		std::shared_ptr<Directory> oldPathParentDir = GetExpandedDirectory(oldPathParentPath);
+		std::shared_ptr<Directory> newPathParentDir = GetExpandedDirectory(newPathParentPath);
 
-		assert(oldPathParentDir && newPathParentDir && "The old or new directory doesn't exist");
+		if (!oldPathParentDir || !newPathParentDir)
+		{
+			assert(lazyExpansion && "The old or new directory doesn't exist");
+
+			// Moved into or out of the expanded part of the tree
+			if (oldPathParentDir)
+				RemoveFile(oldPath);
+			else if (newPathParentDir)
+				AddNewFile(newPath);
+			return;
+		}
 
 		std::shared_ptr<File> fileToRename = oldPathParentDir->GetFile(oldPath.filename().generic_string());
 
@@ -230,13 +1322,25 @@ namespace fs
 	}
 	void DirectoryTree::RenameDirectory(const std::filesystem::path& oldPath, const std::filesystem::path& newPath)
 	{
+		UpdateScope scope{ *this };
+
 		std::filesystem::path oldPathParentPath = oldPath.parent_path();
 		std::filesystem::path newPathParentPath = newPath.parent_path();
 
-		std::shared_ptr<Directory> oldPathParentDir = GetDirectory(oldPathParentPath);
-		std::shared_ptr<Directory> newPathParentDir = GetDirectory(newPathParentPath);
+		std::shared_ptr<Directory> oldPathParentDir = GetExpandedDirectory(oldPathParentPath);
+		std::shared_ptr<Directory> newPathParentDir = GetExpandedDirectory(newPathParentPath);
+
+		if (!oldPathParentDir || !newPathParentDir)
+		{
+			assert(lazyExpansion && "The old or new directory doesn't exist");
 
-		assert(oldPathParentDir && newPathParentDir && "The old or new directory doesn't exist");
+			// Moved into or out of the expanded part of the tree
+			if (oldPathParentDir)
+				RemoveDirectory(oldPath);
+			else if (newPathParentDir)
+				AddNewDirectory(newPath);
+			return;
+		}
 
 		std::shared_ptr<Directory> dirToRename = oldPathParentDir->GetDirectory(oldPath.filename().generic_string());
 
@@ -244,11 +1348,11 @@ namespace fs
 
 		// ResolveChangedPathDirectory(newPath, std::filesystem::path{}, dirToRename);
 
-		EntityPathPairs entities = ConstructDirEntityPathPairs(dirToRename);
+		std::filesystem::path oldDirPath = dirToRename->GetPath();
 
 		dirToRename->Rename(newPath.filename().generic_string());
 
-		ProcessPathChanges(entities);
+		ProcessSubtreePathChange(dirToRename, oldDirPath);
 	}
 
 	void DirectoryTree::ProcessDirectoryTree(DirectoryTreeProcessor* processor)
@@ -256,14 +1360,40 @@ namespace fs
 		if (rootDir)
 			processor->ProcessDirectoryTree(rootDir);
 	}
+	void DirectoryTree::ProcessDirectoryTreeParallel(ParallelDirectoryTreeProcessor* processor, size_t threadCount)
+	{
+		if (!rootDir)
+			return;
+
+		impl::TaskPool pool{ threadCount };
+		processor->BeginProcessing(pool.GetThreadCount());
+
+		// Workers only read the tree, paths are passed down from parents so that no cached path is written
+		pool.Submit([processor, &pool, dir = rootDir.get(), dirPath = rootDir->GetPath()]() {
+			ProcessDirectoryParallel(*processor, pool, *dir, dirPath);
+		});
+		pool.Wait();
+
+		processor->EndProcessing();
+	}
 
 	std::shared_ptr<Directory> DirectoryTree::GetDirectory(const std::filesystem::path& dirPath) const
 	{
-		auto find = directories.find(dirPath);
-		if (find == directories.end())
+		std::shared_ptr<Directory> dir = FindDirectory(dirPath);
+		if (dir || !lazyExpansion || !rootDir)
+			return dir;
+
+		// Not loaded yet, walk down from the root expanding every directory on the way
+		auto component = dirPath.begin();
+		if (component == dirPath.end() || *component != rootDir->GetPath())
 			return std::shared_ptr<Directory>{};
 
-		return find->second;
+		dir = rootDir;
+		for (++component; component != dirPath.end() && dir; ++component)
+		{
+			dir = dir->GetDirectory(component->generic_string());
+		}
+		return dir;
 	}
 
 	std::shared_ptr<Directory> DirectoryTree::GetRootDirectory() const
@@ -271,6 +1401,42 @@ namespace fs
 		return rootDir;
 	}
 
+	GlobQueryRange DirectoryTree::Query(GlobQuery query) const
+	{
+		return GlobQueryRange{ rootDir, std::move(query), lazyExpansion };
+	}
+
+	void DirectoryTree::NotifyEntriesAdded(const Directory::DirectoryEntries& entries)
+	{
+		if (entries.empty())
+			return;
+
+		std::for_each(
+			listeners.begin(), listeners.end(),
+			[&entries](DirectoryTreeEventListener* listener) {
+				listener->OnEntriesAdded(entries);
+			});
+	}
+	void DirectoryTree::NotifyEntriesRemoved(const Directory::DirectoryEntries& entries)
+	{
+		if (entries.empty())
+			return;
+
+		std::for_each(
+			listeners.begin(), listeners.end(),
+			[&entries](DirectoryTreeEventListener* listener) {
+				listener->OnEntriesRemoved(entries);
+			});
+	}
+	void DirectoryTree::NotifySubtreePathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath)
+	{
+		std::for_each(
+			listeners.begin(), listeners.end(),
+			[&dir, &oldPath](DirectoryTreeEventListener* listener) {
+				listener->OnSubtreePathChanged(dir, oldPath);
+			});
+	}
+
 	void DirectoryTree::NotifyDirectoryAdded(std::shared_ptr<Directory> dir)
 	{
 		std::for_each(
@@ -338,53 +1504,658 @@ namespace fs
 	}
 
 	std::shared_ptr<File> DirectoryTree::CreateFile(const std::filesystem::path& relPath) const
+	{
+		std::error_code error;
+		EntryStatus status = scanner.GetStatus(rootDirAbsParentPath / relPath, error);
+		return CreateFile(relPath, status.lastWriteTime, status.size);
+	}
+	std::shared_ptr<File> DirectoryTree::CreateFile(
+		const std::filesystem::path& relPath,
+		std::filesystem::file_time_type lastWriteTime,
+		uint64_t size) const
 	{
 		std::shared_ptr<File> newFile = std::make_shared<File>(relPath);
-		newFile->UpdateStatus(rootDirAbsParentPath); // Set 'lastWriteTime' variable
-		newFile->UpdateStatus(rootDirAbsParentPath); // Reset 'modified' to false
+		newFile->SetLastWriteTime(lastWriteTime);
+		newFile->SetSize(size);
 		return newFile;
 	}
 	std::shared_ptr<Directory> DirectoryTree::CreateDirectory(const std::filesystem::path& relPath) const
+	{
+		std::error_code error;
+		return CreateDirectory(relPath, scanner.GetLastWriteTime(rootDirAbsParentPath / relPath, error));
+	}
+	std::shared_ptr<Directory> DirectoryTree::CreateDirectory(
+		const std::filesystem::path& relPath,
+		std::filesystem::file_time_type lastWriteTime) const
 	{
 		std::shared_ptr<Directory> newDir = std::make_shared<Directory>(relPath);
-		newDir->UpdateStatus(rootDirAbsParentPath); // Set 'lastWriteTime' variable
-		newDir->UpdateStatus(rootDirAbsParentPath); // Reset 'modified' to false
+		newDir->SetSortingType(sortType);
+		newDir->SetLastWriteTime(lastWriteTime);
 		return newDir;
 	}
 
-	std::shared_ptr<Directory> DirectoryTree::BuildTree(const std::filesystem::path& parentDirPath)
+	std::shared_ptr<Directory> DirectoryTree::BuildTree(
+		const std::filesystem::path& parentDirPath,
+		Directory::DirectoryEntries& addedEntries)
 	{
-		// std::shared_ptr<Directory> parentDir = std::make_shared<Directory>(parentDirPath);
-		std::shared_ptr<Directory> parentDir = CreateDirectory(parentDirPath);
-		directories.insert({ parentDirPath, parentDir });
-		
-		for (const auto& entry : std::filesystem::directory_iterator{ rootDirAbsParentPath / parentDirPath })
+		std::error_code error;
+		return BuildTree(parentDirPath, scanner.GetLastWriteTime(rootDirAbsParentPath / parentDirPath, error), addedEntries);
+	}
+	std::shared_ptr<Directory> DirectoryTree::BuildTree(
+		const std::filesystem::path& parentDirPath,
+		std::filesystem::file_time_type lastWriteTime,
+		Directory::DirectoryEntries& addedEntries)
+	{
+		std::shared_ptr<Directory> parentDir = CreateDirectory(parentDirPath, lastWriteTime);
+
+		std::vector<ScannedEntry> entries;
+		scanner.ScanDirectory(rootDirAbsParentPath / parentDirPath, entries);
+
+		parentDir->BeginBulkAppend();
+		for (const auto& entry : entries)
 		{
-			if (entry.is_regular_file())
+			if (entry.type == DirectoryEntryType::FILE)
 			{
-				std::filesystem::path fileName = entry.path().filename();
-
-				// std::shared_ptr<File> newFile = std::make_shared<File>(parentDirPath / fileName, assetType);
-				std::shared_ptr<File> newFile = CreateFile(parentDirPath / fileName);
+				std::shared_ptr<File> newFile = CreateFile(parentDirPath / entry.name, entry.lastWriteTime, entry.size);
 
 				Directory::AddFileToDirectory(parentDir, newFile);
 
-				NotifyFileAdded(newFile);
+				addedEntries.push_back(std::move(newFile));
 			}
-			if (entry.is_directory())
+			else /* if (entry.type == DirectoryEntryType::DIRECTORY) */
 			{
-				std::filesystem::path dirName = entry.path().filename();
-				std::shared_ptr<Directory> newDir = BuildTree(parentDirPath / dirName);
+				std::shared_ptr<Directory> newDir = BuildTree(parentDirPath / entry.name, entry.lastWriteTime, addedEntries);
 
 				Directory::AddDirectoryToDirectory(parentDir, newDir);
 
-				NotifyDirectoryAdded(newDir);
+				addedEntries.push_back(std::move(newDir));
 			}
 		}
+		parentDir->EndBulkAppend();
 
 		return parentDir;
 	}
 
+	bool DirectoryTree::ExpandDirectory(Directory& dir)
+	{
+		UpdateScope scope{ *this };
+
+		std::shared_ptr<Directory> expandedDir = FindDirectory(dir.GetPath());
+		assert(expandedDir && "Only directories of this tree can be expanded");
+
+		std::vector<ScannedEntry> entries;
+		if (!TakePrefetchedListing(dir.GetPath(), entries))
+		{
+			try
+			{
+				scanner.ScanDirectory(rootDirAbsParentPath / dir.GetPath(), entries);
+			}
+			catch (const std::filesystem::filesystem_error& err)
+			{
+				// Most likely removed in the meantime, the event that reports it removes the directory as well
+				expansionErrors.push_back({ dir.GetPath(), err.code() });
+				return false;
+			}
+		}
+
+		// Published as expanded even if it turns out to be empty
+		if (versionTracker)
+			versionTracker->MarkChanged(&dir);
+
+		std::vector<std::shared_ptr<Directory>> newDirs;
+		Directory::DirectoryEntries addedEntries;
+		expandedDir->BeginBulkAppend();
+		for (const auto& entry : entries)
+		{
+			if (entry.type == DirectoryEntryType::FILE)
+			{
+				std::shared_ptr<File> newFile = CreateFile(dir.GetPath() / entry.name, entry.lastWriteTime, entry.size);
+
+				Directory::AddFileToDirectory(expandedDir, newFile);
+
+				addedEntries.push_back(std::move(newFile));
+			}
+			else /* if (entry.type == DirectoryEntryType::DIRECTORY) */
+			{
+				// Directories loaded from a snapshot are expanded eagerly if the tree doesn't use lazy expansion
+				std::shared_ptr<Directory> newDir = lazyExpansion ?
+					CreateLazyDirectory(dir.GetPath() / entry.name, entry.lastWriteTime) :
+					BuildTree(dir.GetPath() / entry.name, entry.lastWriteTime, addedEntries);
+
+				Directory::AddDirectoryToDirectory(expandedDir, newDir);
+
+				addedEntries.push_back(newDir);
+				newDirs.push_back(newDir);
+			}
+		}
+		expandedDir->EndBulkAppend();
+
+		NotifyEntriesAdded(addedEntries);
+
+		if (lazyExpansion && lazyPrefetch)
+			PrefetchListings(newDirs);
+		return true;
+	}
+
+	std::shared_ptr<Directory> DirectoryTree::CreateLazyDirectory(
+		const std::filesystem::path& relPath,
+		std::filesystem::file_time_type lastWriteTime)
+	{
+		std::shared_ptr<Directory> newDir = CreateDirectory(relPath, lastWriteTime);
+		newDir->SetExpander(this);
+		return newDir;
+	}
+
+	std::shared_ptr<Directory> DirectoryTree::GetExpandedDirectory(const std::filesystem::path& dirPath)
+	{
+		std::shared_ptr<Directory> dir = FindDirectory(dirPath);
+		if (dir && dir->IsExpanded())
+			return dir;
+
+		InvalidatePrefetchedListing(dirPath);
+		return std::shared_ptr<Directory>{};
+	}
+	std::shared_ptr<Directory> DirectoryTree::FindDirectory(const std::filesystem::path& dirPath) const
+	{
+		if (!rootDir)
+			return std::shared_ptr<Directory>{};
+
+		// Components are viewed in place, nothing is copied until the directory is found
+#ifdef _WIN32
+		const std::string pathString = dirPath.generic_string();
+		std::string_view rest{ pathString };
+#else
+		// The native format already is the generic one
+		std::string_view rest{ dirPath.native() };
+#endif
+		const std::shared_ptr<Directory>* dir = nullptr;
+		while (!rest.empty())
+		{
+			size_t separator = rest.find('/');
+			std::string_view component = rest.substr(0, separator);
+			rest = separator == std::string_view::npos ? std::string_view{} : rest.substr(separator + 1);
+			if (component.empty())
+				continue;
+
+			if (!dir)
+				dir = component == rootDir->GetNameRef() ? &rootDir : nullptr;
+			else
+				dir = (*dir)->FindDirectory(component);
+			if (!dir)
+				return std::shared_ptr<Directory>{};
+		}
+		return dir ? *dir : std::shared_ptr<Directory>{};
+	}
+
+	void DirectoryTree::PrefetchListings(const std::vector<std::shared_ptr<Directory>>& dirs)
+	{
+		if (dirs.empty())
+			return;
+
+		if (!prefetchPool)
+			prefetchPool = std::make_unique<impl::TaskPool>(prefetchThreadCount);
+
+		for (const auto& dir : dirs)
+		{
+			uint64_t requestIndex = 0;
+			{
+				std::lock_guard lock{ prefetchMutex };
+				requestIndex = ++prefetchRequestCount;
+				PrefetchedListing& listing = prefetchedListings[dir->GetPath()];
+				listing = PrefetchedListing{};
+				listing.requestIndex = requestIndex;
+			}
+
+			// Workers only touch the disk and 'prefetchedListings', never the tree itself
+			prefetchPool->Submit([this, requestIndex, dirPath = dir->GetPath(), absPath = rootDirAbsParentPath / dir->GetPath()]() {
+				std::vector<ScannedEntry> entries;
+				bool scanned = true;
+				try
+				{
+					scanner.ScanDirectory(absPath, entries);
+				}
+				catch (const std::filesystem::filesystem_error&)
+				{
+					// Reported when the directory is expanded and listed again
+					scanned = false;
+				}
+
+				std::lock_guard lock{ prefetchMutex };
+				auto find = prefetchedListings.find(dirPath);
+				// Dropped or requested again while the listing was running
+				if (find == prefetchedListings.end() || find->second.requestIndex != requestIndex)
+					return;
+
+				if (!scanned)
+				{
+					prefetchedListings.erase(find);
+					return;
+				}
+				find->second.entries = std::move(entries);
+				find->second.ready = true;
+			});
+		}
+	}
+	bool DirectoryTree::TakePrefetchedListing(const std::filesystem::path& dirPath, std::vector<ScannedEntry>& entries)
+	{
+		if (!prefetchPool)
+			return false;
+
+		std::lock_guard lock{ prefetchMutex };
+		auto find = prefetchedListings.find(dirPath);
+		if (find == prefetchedListings.end())
+			return false;
+
+		// A listing that's still running is dropped, waiting for it wouldn't be any faster than listing the directory here
+		bool ready = find->second.ready;
+		if (ready)
+			entries = std::move(find->second.entries);
+		prefetchedListings.erase(find);
+		return ready;
+	}
+	void DirectoryTree::InvalidatePrefetchedListing(const std::filesystem::path& dirPath)
+	{
+		if (!prefetchPool)
+			return;
+
+		std::lock_guard lock{ prefetchMutex };
+		prefetchedListings.erase(dirPath);
+	}
+	void DirectoryTree::InvalidatePrefetchedListings(const std::filesystem::path& dirPath)
+	{
+		if (!prefetchPool)
+			return;
+
+		// Only requested listings are in the map, so it's cheaper to go through them than through the subtree
+		std::lock_guard lock{ prefetchMutex };
+		for (auto listing = prefetchedListings.begin(); listing != prefetchedListings.end();)
+		{
+			auto mismatch = std::mismatch(dirPath.begin(), dirPath.end(), listing->first.begin(), listing->first.end());
+			if (mismatch.first == dirPath.end())
+				listing = prefetchedListings.erase(listing);
+			else
+				++listing;
+		}
+	}
+
+	void DirectoryTree::PublishChanges()
+	{
+		if (!versionTracker)
+			return;
+
+		std::shared_ptr<const TreeVersionDirectory> publishedRoot;
+		if (rootDir)
+			publishedRoot = versionTracker->PublishDirectory(*rootDir);
+		versionTracker->ClearChanges();
+
+		// Readers that already hold the previous version keep it alive until they're done with it
+		std::atomic_store(
+			&publishedVersion,
+			std::shared_ptr<const TreeVersion>{ std::make_shared<const TreeVersion>(publishedRoot, ++publishedVersionCount) });
+	}
+
+	std::shared_ptr<Directory> DirectoryTree::BuildTreeParallel(
+		const std::filesystem::path& parentDirPath,
+		Directory::DirectoryEntries& addedEntries)
+	{
+		// Workers only create and stat entries of the subtrees they own.
+		// Everything that touches the shared state (listeners, linking
+		// subtrees to their parents) happens on the calling thread during the merge,
+		// which walks the scanned subtrees in the same order 'BuildTree' would.
+
+		ScannedDirectory scannedRoot{};
+		scannedRoot.dir = CreateDirectory(parentDirPath);
+
+		{
+			impl::TaskPool pool{ buildThreadCount };
+			pool.Submit([this, &pool, &scannedRoot]() {
+				ScanSubtree(pool, &scannedRoot);
+			});
+			pool.Wait();
+		}
+
+		MergeScannedDirectory(&scannedRoot, addedEntries);
+
+		return scannedRoot.dir;
+	}
+	void DirectoryTree::ScanSubtree(impl::TaskPool& pool, ScannedDirectory* scannedDir) const
+	{
+		const std::filesystem::path& parentDirPath = scannedDir->dir->GetPath();
+
+		std::vector<ScannedEntry> entries;
+		scanner.ScanDirectory(rootDirAbsParentPath / parentDirPath, entries);
+
+		// Only the files are added here, subdirectories are added once they're merged
+		scannedDir->dir->BeginBulkAppend();
+		for (const auto& entry : entries)
+		{
+			if (entry.type == DirectoryEntryType::FILE)
+			{
+				std::shared_ptr<File> newFile = CreateFile(parentDirPath / entry.name, entry.lastWriteTime, entry.size);
+
+				Directory::AddFileToDirectory(scannedDir->dir, newFile);
+
+				ScannedChild scannedFile{};
+				scannedFile.file = newFile;
+				scannedDir->entries.push_back(std::move(scannedFile));
+			}
+			else /* if (entry.type == DirectoryEntryType::DIRECTORY) */
+			{
+				ScannedChild scannedSubdir{};
+				scannedSubdir.dir = std::make_unique<ScannedDirectory>();
+				scannedSubdir.dir->dir = CreateDirectory(parentDirPath / entry.name, entry.lastWriteTime);
+
+				// The 'ScannedDirectory' object itself never moves, only the 'unique_ptr' that owns it
+				ScannedDirectory* subdir = scannedSubdir.dir.get();
+				scannedDir->entries.push_back(std::move(scannedSubdir));
+
+				pool.Submit([this, &pool, subdir]() {
+					ScanSubtree(pool, subdir);
+				});
+			}
+		}
+		scannedDir->dir->EndBulkAppend();
+	}
+	void DirectoryTree::MergeScannedDirectory(ScannedDirectory* scannedDir, Directory::DirectoryEntries& addedEntries)
+	{
+		scannedDir->dir->BeginBulkAppend();
+		for (auto& entry : scannedDir->entries)
+		{
+			if (entry.file)
+			{
+				addedEntries.push_back(std::move(entry.file));
+			}
+			else
+			{
+				MergeScannedDirectory(entry.dir.get(), addedEntries);
+
+				Directory::AddDirectoryToDirectory(scannedDir->dir, entry.dir->dir);
+
+				addedEntries.push_back(entry.dir->dir);
+			}
+		}
+		scannedDir->dir->EndBulkAppend();
+	}
+
+	bool DirectoryTree::BuildTreeFromSnapshot(
+		const std::byte* snapshotData,
+		size_t snapshotSize,
+		const std::filesystem::path& rootDirRelPath,
+		std::vector<std::shared_ptr<Directory>>& unexpandedDirs)
+	{
+		// Validate everything first, so that listeners never hear about a partially loaded tree
+
+		if (snapshotSize < sizeof(TreeSnapshotHeader))
+			return false;
+
+		TreeSnapshotHeader header{};
+		std::memcpy(&header, snapshotData, sizeof(header));
+
+		if (std::memcmp(header.magic, treeSnapshotMagic, sizeof(header.magic)) != 0 ||
+			header.version != treeSnapshotVersion ||
+			header.recordSize != sizeof(TreeSnapshotRecord) ||
+			header.timePeriodNum != std::filesystem::file_time_type::period::num ||
+			header.timePeriodDen != std::filesystem::file_time_type::period::den ||
+			header.entryCount == 0)
+		{
+			return false;
+		}
+
+		if (!impl::HasFileLayout(snapshotSize, sizeof(TreeSnapshotHeader), header.entryCount, sizeof(TreeSnapshotRecord), header.namesSize))
+			return false;
+		uint64_t recordsSize = header.entryCount * sizeof(TreeSnapshotRecord);
+
+		// The records that follow the header stay 8 byte aligned
+		static_assert(sizeof(TreeSnapshotHeader) == 48 && sizeof(TreeSnapshotHeader) % alignof(TreeSnapshotRecord) == 0);
+		const TreeSnapshotRecord* records =
+			reinterpret_cast<const TreeSnapshotRecord*>(snapshotData + sizeof(TreeSnapshotHeader));
+		const char* names = reinterpret_cast<const char*>(snapshotData + sizeof(TreeSnapshotHeader) + recordsSize);
+
+		for (uint64_t i = 0; i < header.entryCount; i++)
+		{
+			const TreeSnapshotRecord& record = records[i];
+			bool validType =
+				record.type == static_cast<uint8_t>(DirectoryEntryType::DIRECTORY) ||
+				record.type == static_cast<uint8_t>(DirectoryEntryType::FILE);
+			bool validParent = i == 0 ?
+				record.type == static_cast<uint8_t>(DirectoryEntryType::DIRECTORY) :
+				record.parentIndex < i &&
+				records[record.parentIndex].type == static_cast<uint8_t>(DirectoryEntryType::DIRECTORY);
+			if (!validType || !validParent ||
+				record.sortType > static_cast<uint8_t>(DirEntrySortType::LAST_WRITE_TIME_H_TO_L) ||
+				(record.flags & ~treeSnapshotUnexpandedFlag) != 0 ||
+				static_cast<uint64_t>(record.nameOffset) + record.nameLength > header.namesSize)
+			{
+				return false;
+			}
+		}
+
+		std::string_view snapshotRootName{ names + records[0].nameOffset, records[0].nameLength };
+		if (snapshotRootName != rootDirRelPath.string())
+			return false;
+
+		// The snapshot is valid, nothing of the tree loaded before it survives
+		ResetTree();
+
+		auto toFileTime = [](const TreeSnapshotRecord& record) {
+			return std::filesystem::file_time_type{ std::filesystem::file_time_type::duration{ record.lastWriteTime } };
+		};
+
+		// Directories are indexed by their record index, other slots stay empty
+		std::vector<std::shared_ptr<Directory>> loadedDirs(header.entryCount);
+
+		auto loadDirectory = [&](const TreeSnapshotRecord& record, const std::filesystem::path& relPath) {
+			std::shared_ptr<Directory> newDir = CreateDirectory(relPath, toFileTime(record));
+			newDir->SetSortingType(static_cast<DirEntrySortType>(record.sortType));
+			// Sorted once all of the records are loaded
+			newDir->BeginBulkAppend();
+			if (record.flags & treeSnapshotUnexpandedFlag)
+			{
+				newDir->SetExpander(this);
+				unexpandedDirs.push_back(newDir);
+			}
+			return newDir;
+		};
+
+		rootDir = loadDirectory(records[0], rootDirRelPath);
+		loadedDirs[0] = rootDir;
+
+		Directory::DirectoryEntries addedEntries;
+		addedEntries.reserve(header.entryCount - 1);
+
+		for (uint64_t i = 1; i < header.entryCount; i++)
+		{
+			const TreeSnapshotRecord& record = records[i];
+			std::shared_ptr<Directory> parentDir = loadedDirs[record.parentIndex];
+			std::filesystem::path relPath = parentDir->GetPath() / std::string_view{ names + record.nameOffset, record.nameLength };
+
+			if (record.type == static_cast<uint8_t>(DirectoryEntryType::FILE))
+			{
+				std::shared_ptr<File> newFile = CreateFile(relPath, toFileTime(record), record.size);
+
+				Directory::AddFileToDirectory(parentDir, newFile);
+
+				addedEntries.push_back(std::move(newFile));
+			}
+			else /* if (record.type == static_cast<uint8_t>(DirectoryEntryType::DIRECTORY)) */
+			{
+				std::shared_ptr<Directory> newDir = loadDirectory(record, relPath);
+				loadedDirs[i] = newDir;
+
+				// Attached while still empty, so its path is simply set
+				Directory::AddDirectoryToDirectory(parentDir, newDir);
+
+				addedEntries.push_back(std::move(newDir));
+			}
+		}
+
+		for (const auto& loadedDir : loadedDirs)
+		{
+			if (loadedDir)
+				loadedDir->EndBulkAppend();
+		}
+
+		NotifyEntriesAdded(addedEntries);
+		if (nameSearchIndex)
+			nameSearchIndex->OnDirectoryAdded(rootDir);
+
+		return true;
+	}
+
+	void DirectoryTree::ReconcileDirectories(
+		std::vector<std::pair<std::shared_ptr<Directory>, bool>> dirsToVisit,
+		RescanStatistics& statistics)
+	{
+		// Every directory in 'dirsToVisit' is up to date itself, the flag tells whether its last write
+		// time changed. The tree is processed level by level:
+		//
+		// A directory whose last write time didn't change still has the same set of entries,
+		// so they're only stat'ed. The entries of all such directories of a level are queried in one batch.
+		// A directory whose last write time changed is listed again and its entries are compared against the listing.
+		// Both kinds of directories pass their surviving subdirectories on to the next level.
+
+		while (!dirsToVisit.empty())
+		{
+			std::vector<std::pair<std::shared_ptr<Directory>, bool>> nextLevel;
+
+			std::vector<std::shared_ptr<DirectoryEntry>> entriesToStat;
+			for (const auto& [dir, dirChanged] : dirsToVisit)
+			{
+				if (!dirChanged)
+				{
+					entriesToStat.insert(entriesToStat.end(), dir->GetLoadedFiles().begin(), dir->GetLoadedFiles().end());
+					entriesToStat.insert(entriesToStat.end(), dir->GetLoadedDirectories().begin(), dir->GetLoadedDirectories().end());
+				}
+			}
+
+			std::vector<std::filesystem::path> absPaths;
+			absPaths.reserve(entriesToStat.size());
+			for (const auto& entry : entriesToStat)
+			{
+				absPaths.push_back(rootDirAbsParentPath / entry->GetPath());
+			}
+
+			std::vector<EntryStatus> statuses;
+			std::vector<std::error_code> errors;
+			statusRefresher.QueryStatus(absPaths, statuses, errors);
+			statistics.entriesStated += entriesToStat.size();
+
+			for (size_t i = 0; i < entriesToStat.size(); i++)
+			{
+				// An entry that can't be queried anymore is left alone. Removing it
+				// changes the parent's last write time, so it's handled when the parent is listed again.
+				if (errors[i])
+					continue;
+
+				bool entryChanged = statuses[i].lastWriteTime != entriesToStat[i]->GetLastWriteTime();
+				if (entryChanged)
+					entriesToStat[i]->SetLastWriteTime(statuses[i].lastWriteTime);
+				if (entriesToStat[i]->IsFile())
+				{
+					File& file = static_cast<File&>(*entriesToStat[i]);
+					entryChanged = entryChanged || statuses[i].size != file.GetSize();
+					file.SetSize(statuses[i].size);
+				}
+
+				if (entriesToStat[i]->IsDirectory())
+				{
+					std::shared_ptr<Directory> subdir = std::static_pointer_cast<Directory>(entriesToStat[i]);
+					if (entryChanged)
+						NotifyDirectoryModified(subdir);
+					nextLevel.push_back({ subdir, entryChanged });
+				}
+				else if (entryChanged)
+				{
+					// Whatever it was hashed from isn't there anymore
+					static_cast<File&>(*entriesToStat[i]).ClearContentHash();
+					NotifyFileModified(std::static_pointer_cast<File>(entriesToStat[i]));
+				}
+			}
+
+			for (const auto& [dir, dirChanged] : dirsToVisit)
+			{
+				if (!dirChanged)
+					continue;
+
+				// Nothing's been loaded from an unexpanded directory, it's going to be listed from scratch anyway
+				if (dir->IsExpanded())
+					ReconcileDirectoryEntries(dir, nextLevel, statistics);
+				else
+					InvalidatePrefetchedListing(dir->GetPath());
+			}
+
+			dirsToVisit = std::move(nextLevel);
+		}
+	}
+	void DirectoryTree::ReconcileDirectoryEntries(
+		std::shared_ptr<Directory> dir,
+		std::vector<std::pair<std::shared_ptr<Directory>, bool>>& subdirsToVisit,
+		RescanStatistics& statistics)
+	{
+		std::vector<ScannedEntry> scannedEntries;
+		scanner.ScanDirectory(rootDirAbsParentPath / dir->GetPath(), scannedEntries);
+		statistics.directoriesListed++;
+
+		// Views into 'scannedEntries'
+		std::unordered_set<std::string_view> scannedFiles;
+		std::unordered_set<std::string_view> scannedDirs;
+		for (const auto& scannedEntry : scannedEntries)
+		{
+			if (scannedEntry.type == DirectoryEntryType::FILE)
+				scannedFiles.insert(scannedEntry.name);
+			else
+				scannedDirs.insert(scannedEntry.name);
+		}
+
+		for (const auto& file : dir->GetFiles())
+		{
+			if (scannedFiles.find(file->GetFullFileName()) == scannedFiles.end())
+				RemoveFile(file->GetPath());
+		}
+		for (const auto& subdir : dir->GetDirectories())
+		{
+			if (scannedDirs.find(subdir->GetDirectoryName()) == scannedDirs.end())
+				RemoveDirectory(subdir->GetPath());
+		}
+
+		for (const auto& scannedEntry : scannedEntries)
+		{
+			if (scannedEntry.type == DirectoryEntryType::FILE)
+			{
+				std::shared_ptr<File> file = dir->GetFile(scannedEntry.name);
+				if (!file)
+				{
+					AddNewFile(dir->GetPath() / scannedEntry.name);
+				}
+				else if (file->GetLastWriteTime() != scannedEntry.lastWriteTime || file->GetSize() != scannedEntry.size)
+				{
+					file->SetLastWriteTime(scannedEntry.lastWriteTime);
+					file->SetSize(scannedEntry.size);
+					file->ClearContentHash();
+					NotifyFileModified(file);
+				}
+			}
+			else /* if (scannedEntry.type == DirectoryEntryType::DIRECTORY) */
+			{
+				std::shared_ptr<Directory> subdir = dir->GetDirectory(scannedEntry.name);
+				if (!subdir)
+				{
+					// Built from scratch, so there's nothing to reconcile inside
+					AddNewDirectory(dir->GetPath() / scannedEntry.name);
+					continue;
+				}
+
+				bool subdirChanged = subdir->GetLastWriteTime() != scannedEntry.lastWriteTime;
+				if (subdirChanged)
+				{
+					subdir->SetLastWriteTime(scannedEntry.lastWriteTime);
+					NotifyDirectoryModified(subdir);
+				}
+				subdirsToVisit.push_back({ subdir, subdirChanged });
+			}
+		}
+	}
+
 	/*
 	void DirectoryTree::ResolveChangedPathDirectory(
 		const std::filesystem::path& newDirPath,
@@ -415,33 +2186,96 @@ namespace fs
 	}
 	*/
 
-	DirectoryTree::EntityPathPairs DirectoryTree::ConstructDirEntityPathPairs(std::shared_ptr<Directory> dir)
+	void DirectoryTree::ProcessSubtreePathChange(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath)
+	{
+		InvalidatePrefetchedListings(oldPath);
+
+		NotifySubtreePathChanged(dir, oldPath);
+	}
+
+	void DirectoryTree::SortFilesParallel(Directory& dir, impl::TaskPool& pool)
 	{
-		EntityPathPairs entities;
-		entities.push_back(std::make_pair(dir, dir->GetPath()));
-		for (const auto& entity : dir->GetDirEntriesRecursive())
+		// Every worker sorts a chunk of its own, then neighbouring chunks are merged pairwise until one is left
+		std::vector<Directory::Files> chunks(pool.GetThreadCount());
+		size_t chunkSize = (dir.files.size() + chunks.size() - 1) / chunks.size();
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			auto first = dir.files.begin() + std::min(i * chunkSize, dir.files.size());
+			auto last = dir.files.begin() + std::min((i + 1) * chunkSize, dir.files.size());
+			chunks[i].assign(std::make_move_iterator(first), std::make_move_iterator(last));
+		}
+
+		Sorter* sorter = dir.sorter;
+		for (auto& chunk : chunks)
 		{
-			entities.push_back(std::make_pair(entity, entity->GetPath()));
+			pool.Submit([sorter, &chunk]() {
+				sorter->SortFiles(chunk);
+			});
+		}
+		pool.Wait();
+
+		for (size_t step = 1; step < chunks.size(); step *= 2)
+		{
+			for (size_t i = 0; i + step < chunks.size(); i += 2 * step)
+			{
+				pool.Submit([sorter, &chunk = chunks[i], &next = chunks[i + step]]() {
+					size_t sortedCount = chunk.size();
+					chunk.insert(chunk.end(), std::make_move_iterator(next.begin()), std::make_move_iterator(next.end()));
+					next.clear();
+					sorter->MergeFiles(chunk, sortedCount);
+				});
+			}
+			pool.Wait();
 		}
-		return entities;
+
+		dir.files = std::move(chunks[0]);
+		dir.sortedFileCount = dir.files.size();
 	}
-	void DirectoryTree::ProcessPathChanges(const DirectoryTree::EntityPathPairs& oldPathPairs)
+
+	std::vector<std::pair<std::filesystem::path, std::error_code>> DirectoryTree::ProcessModifiedFilesByContent(
+		const std::vector<std::shared_ptr<DirectoryEntry>>& files)
 	{
-		for (const auto& entity : oldPathPairs)
+		std::vector<std::error_code> statusErrors = statusRefresher.RefreshStatus(files, rootDirAbsParentPath);
+
+		std::vector<std::pair<std::filesystem::path, std::error_code>> failedEntries;
+		std::vector<std::shared_ptr<File>> filesToHash;
+		std::vector<std::filesystem::path> absPaths;
+		for (size_t i = 0; i < files.size(); i++)
 		{
-			if (entity.first->IsDirectory())
+			if (statusErrors[i])
 			{
-				std::shared_ptr<Directory> dir = std::static_pointer_cast<Directory>(entity.first);
+				failedEntries.push_back({ files[i]->GetPath(), statusErrors[i] });
+				continue;
+			}
+			filesToHash.push_back(std::static_pointer_cast<File>(files[i]));
+			absPaths.push_back(rootDirAbsParentPath / files[i]->GetPath());
+		}
+
+		std::vector<uint64_t> hashes;
+		std::vector<std::error_code> hashErrors;
+		contentHasher->HashFiles(absPaths, hashes, hashErrors);
 
-				directories.erase(entity.second);
-				directories.insert({ dir->GetPath(), dir});
+		for (size_t i = 0; i < filesToHash.size(); i++)
+		{
+			const std::shared_ptr<File>& file = filesToHash[i];
 
-				NotifyDirectoryPathChanged(dir, entity.second);
+			bool modified = file->Modified();
+			if (hashErrors[i])
+			{
+				// Nothing to compare the next hash with
+				failedEntries.push_back({ file->GetPath(), hashErrors[i] });
+				file->ClearContentHash();
 			}
-			else /* if (entity.first->IsFile()) */
+			else
 			{
-				NotifyFilePathChanged(std::static_pointer_cast<File>(entity.first), entity.second);
+				if (file->HasContentHash())
+					modified = file->GetContentHash() != hashes[i];
+				file->SetContentHash(hashes[i]);
 			}
+
+			if (modified)
+				NotifyFileModified(file);
 		}
+		return failedEntries;
 	}
 }
\ No newline at end of file
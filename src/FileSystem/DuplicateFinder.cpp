@@ -0,0 +1,314 @@
+#include "../../include/FileSystem/DuplicateFinder.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace fs
+{
+	// How much of every file is hashed before deciding whether it's worth reading the rest
+	constexpr size_t prefixSize{ 4096 };
+
+	DuplicateFinder::DuplicateFinder()
+	{
+	}
+	DuplicateFinder::~DuplicateFinder()
+	{
+	}
+
+	void DuplicateFinder::OnFileAdded(std::shared_ptr<File> file)
+	{
+		Insert(std::move(file));
+	}
+	void DuplicateFinder::OnDirectoryAdded(std::shared_ptr<Directory>)
+	{
+	}
+
+	void DuplicateFinder::OnFileRemoved(std::shared_ptr<File> file)
+	{
+		Erase(*file);
+	}
+	void DuplicateFinder::OnDirectoryRemoved(std::shared_ptr<Directory>)
+	{
+	}
+
+	void DuplicateFinder::OnFilePathChanged(std::shared_ptr<File>, const std::filesystem::path&)
+	{
+	}
+	void DuplicateFinder::OnDirectoryPathChanged(std::shared_ptr<Directory>, const std::filesystem::path&)
+	{
+	}
+	void DuplicateFinder::OnSubtreePathChanged(std::shared_ptr<Directory>, const std::filesystem::path&)
+	{
+	}
+
+	void DuplicateFinder::OnFileModified(std::shared_ptr<File> file)
+	{
+		// Its size might have changed, which moves it to another group
+		Erase(*file);
+		Insert(std::move(file));
+	}
+	void DuplicateFinder::OnDirectoryModified(std::shared_ptr<Directory>)
+	{
+	}
+
+	void DuplicateFinder::Clear()
+	{
+		sizeGroups.clear();
+		fileSizes.clear();
+		dirtySizes.clear();
+		sizesWithDuplicates.clear();
+		duplicateGroupCount = 0;
+		wastedSize = 0;
+	}
+
+	std::vector<std::pair<std::filesystem::path, std::error_code>> DuplicateFinder::Update(const std::filesystem::path& absPart)
+	{
+		std::vector<std::pair<std::filesystem::path, std::error_code>> failedEntries;
+
+		// Groups emptied in the meantime are gone already, groups marked more than once are only taken once.
+		// Nothing is added to 'sizeGroups' from here on, so the pointers stay valid.
+		std::vector<std::pair<uint64_t, SizeGroup*>> groups;
+		for (uint64_t size : dirtySizes)
+		{
+			auto group = sizeGroups.find(size);
+			if (group == sizeGroups.end() || !group->second.dirty)
+				continue;
+
+			group->second.dirty = false;
+			ForgetDuplicates(size, group->second);
+			groups.push_back({ size, &group->second });
+		}
+		dirtySizes.clear();
+
+		std::vector<std::pair<uint64_t, TrackedFile*>> filesToRead;
+		std::vector<std::filesystem::path> absPaths;
+		std::vector<uint64_t> hashes;
+		std::vector<std::error_code> errors;
+
+		// First blocks of every file that has something of the same size to be compared with
+		for (auto& [size, group] : groups)
+		{
+			if (group->files.size() < 2)
+				continue;
+
+			for (TrackedFile& tracked : group->files)
+			{
+				tracked.failed = false;
+				if (tracked.hasPrefixHash)
+					continue;
+
+				if (size <= prefixSize && tracked.file->HasContentHash())
+				{
+					tracked.prefixHash = tracked.contentHash = tracked.file->GetContentHash();
+					tracked.hasPrefixHash = tracked.hasContentHash = true;
+					continue;
+				}
+				filesToRead.push_back({ size, &tracked });
+				absPaths.push_back(absPart / tracked.file->GetPath());
+			}
+		}
+
+		hasher.HashFilePrefixes(absPaths, prefixSize, hashes, errors);
+		for (size_t i = 0; i < filesToRead.size(); i++)
+		{
+			auto [size, tracked] = filesToRead[i];
+			if (errors[i])
+			{
+				tracked->failed = true;
+				failedEntries.push_back({ tracked->file->GetPath(), errors[i] });
+				continue;
+			}
+
+			tracked->prefixHash = hashes[i];
+			tracked->hasPrefixHash = true;
+			// The first block was all of it
+			if (size <= prefixSize)
+			{
+				tracked->contentHash = hashes[i];
+				tracked->hasContentHash = true;
+			}
+		}
+
+		// Complete contents of the files that share their first block with another one
+		filesToRead.clear();
+		absPaths.clear();
+		for (auto& [size, group] : groups)
+		{
+			if (group->files.size() < 2)
+				continue;
+
+			std::sort(group->files.begin(), group->files.end(), [](const TrackedFile& file1, const TrackedFile& file2) {
+				return std::pair{ file1.failed, file1.prefixHash } < std::pair{ file2.failed, file2.prefixHash };
+			});
+
+			auto first = group->files.begin();
+			auto end = std::find_if(group->files.begin(), group->files.end(), [](const TrackedFile& file) {
+				return file.failed;
+			});
+			while (first != end)
+			{
+				auto last = std::find_if(first, end, [first](const TrackedFile& file) {
+					return file.prefixHash != first->prefixHash;
+				});
+
+				if (last - first >= 2)
+				{
+					for (auto tracked = first; tracked != last; ++tracked)
+					{
+						if (tracked->hasContentHash)
+							continue;
+
+						if (tracked->file->HasContentHash())
+						{
+							tracked->contentHash = tracked->file->GetContentHash();
+							tracked->hasContentHash = true;
+							continue;
+						}
+						filesToRead.push_back({ size, &*tracked });
+						absPaths.push_back(absPart / tracked->file->GetPath());
+					}
+				}
+				first = last;
+			}
+		}
+
+		hasher.HashFiles(absPaths, hashes, errors);
+		for (size_t i = 0; i < filesToRead.size(); i++)
+		{
+			TrackedFile* tracked = filesToRead[i].second;
+			if (errors[i])
+			{
+				tracked->failed = true;
+				failedEntries.push_back({ tracked->file->GetPath(), errors[i] });
+				continue;
+			}
+
+			tracked->contentHash = hashes[i];
+			tracked->hasContentHash = true;
+		}
+
+		for (auto& [size, group] : groups)
+		{
+			FindDuplicates(size, *group);
+		}
+		return failedEntries;
+	}
+
+	std::vector<DuplicateGroup> DuplicateFinder::GetDuplicateGroups() const
+	{
+		std::vector<DuplicateGroup> result;
+		result.reserve(duplicateGroupCount);
+		for (uint64_t size : sizesWithDuplicates)
+		{
+			const SizeGroup& group = sizeGroups.at(size);
+			result.insert(result.end(), group.duplicates.begin(), group.duplicates.end());
+		}
+		return result;
+	}
+	size_t DuplicateFinder::GetDuplicateGroupCount() const
+	{
+		return duplicateGroupCount;
+	}
+	uint64_t DuplicateFinder::GetWastedSize() const
+	{
+		return wastedSize;
+	}
+
+	ContentHasher& DuplicateFinder::GetContentHasher()
+	{
+		return hasher;
+	}
+
+	void DuplicateFinder::Insert(std::shared_ptr<File> file)
+	{
+		uint64_t size = file->GetSize();
+		if (size == 0 || !fileSizes.insert({ file.get(), size }).second)
+			return;
+
+		SizeGroup& group = sizeGroups[size];
+		group.files.push_back(TrackedFile{ std::move(file) });
+		MarkDirty(size, group);
+	}
+	void DuplicateFinder::Erase(const File& file)
+	{
+		auto fileSize = fileSizes.find(&file);
+		if (fileSize == fileSizes.end())
+			return;
+
+		uint64_t size = fileSize->second;
+		fileSizes.erase(fileSize);
+
+		auto groupIt = sizeGroups.find(size);
+		SizeGroup& group = groupIt->second;
+		auto tracked = std::find_if(group.files.begin(), group.files.end(), [&file](const TrackedFile& tracked) {
+			return tracked.file.get() == &file;
+		});
+		*tracked = std::move(group.files.back());
+		group.files.pop_back();
+
+		if (group.files.empty())
+		{
+			ForgetDuplicates(size, group);
+			sizeGroups.erase(groupIt);
+			return;
+		}
+		MarkDirty(size, group);
+	}
+	void DuplicateFinder::MarkDirty(uint64_t size, SizeGroup& group)
+	{
+		if (group.dirty)
+			return;
+
+		group.dirty = true;
+		dirtySizes.push_back(size);
+	}
+
+	void DuplicateFinder::FindDuplicates(uint64_t size, SizeGroup& group)
+	{
+		auto end = std::partition(group.files.begin(), group.files.end(), [](const TrackedFile& file) {
+			return file.hasContentHash && !file.failed;
+		});
+		std::sort(group.files.begin(), end, [](const TrackedFile& file1, const TrackedFile& file2) {
+			return file1.contentHash < file2.contentHash;
+		});
+
+		for (auto first = group.files.begin(); first != end;)
+		{
+			auto last = std::find_if(first, end, [first](const TrackedFile& file) {
+				return file.contentHash != first->contentHash;
+			});
+
+			if (last - first >= 2)
+			{
+				DuplicateGroup duplicates{ size, first->contentHash, {} };
+				duplicates.files.reserve(last - first);
+				for (auto tracked = first; tracked != last; ++tracked)
+				{
+					duplicates.files.push_back(tracked->file);
+				}
+				wastedSize += size * (duplicates.files.size() - 1);
+				group.duplicates.push_back(std::move(duplicates));
+			}
+			first = last;
+		}
+
+		if (!group.duplicates.empty())
+		{
+			duplicateGroupCount += group.duplicates.size();
+			sizesWithDuplicates.insert(size);
+		}
+	}
+	void DuplicateFinder::ForgetDuplicates(uint64_t size, SizeGroup& group)
+	{
+		if (group.duplicates.empty())
+			return;
+
+		for (const DuplicateGroup& duplicates : group.duplicates)
+		{
+			wastedSize -= size * (duplicates.files.size() - 1);
+		}
+		duplicateGroupCount -= group.duplicates.size();
+		sizesWithDuplicates.erase(size);
+		group.duplicates.clear();
+	}
+}
\ No newline at end of file
@@ -1,21 +1,194 @@
 #include "../../include/FileSystem/FileSystemCommon.h"
+#include "../../include/FileSystem/SortedView.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string_view>
+#include <utility>
 
 namespace fs
 {
+	// Directories with fewer entries than this are scanned instead of indexed
+	constexpr size_t nameIndexThreshold{ 32 };
+
+	// Bumped whenever a directory that has entries in it gets a different path. Every path cached
+	// before that is recomputed from the parent's path the next time it's asked for, so moving or renaming
+	// a directory costs the same no matter how many entries there are under it.
+	// It's shared by all trees: an entry doesn't know which tree it belongs to, subtrees are built on their own
+	// and attached later. A bump caused by another tree only makes the next 'GetPath' compare the path again,
+	// the cached one is left as it is.
+	static std::atomic<uint64_t> pathGeneration{ 1 };
+
+	// Paths are recomputed under one of these, picked by the entry's address,
+	// so readers of the same tree don't write the same cached path at the same time
+	constexpr size_t pathCacheMutexCount{ 64 };
+
+	static std::mutex& GetPathCacheMutex(const DirectoryEntry* entry)
+	{
+		static std::mutex mutexes[pathCacheMutexCount];
+		return mutexes[reinterpret_cast<uintptr_t>(entry) / alignof(std::max_align_t) % pathCacheMutexCount];
+	}
+
 	// Comparators
+	//
+	// Every sorting type gets its own instantiation, the key and the order are known at compile time,
+	// so a comparison is a plain key comparison without branches, virtual calls or reference counting.
+
+	// Below this many entries the keys aren't worth copying out of the entries
+	constexpr size_t minEntriesToSortByKeys{ 64 };
+
+	struct NameKey
+	{
+		// Points into the entry's name, valid as long as the entry is alive and isn't renamed
+		using Type = std::string_view;
+
+		static Type Get(const DirectoryEntry& entry)
+		{
+			return entry.GetNameRef();
+		}
+	};
+	struct LastWriteTimeKey
+	{
+		using Type = std::filesystem::file_time_type;
+
+		static Type Get(const DirectoryEntry& entry)
+		{
+			return entry.GetLastWriteTime();
+		}
+	};
+
+	template<typename Key, typename Comp, typename Iterator>
+	static void SortEntries(Iterator first, Iterator last)
+	{
+		using EntryPtr = typename std::iterator_traits<Iterator>::value_type;
+
+		if (static_cast<size_t>(last - first) < minEntriesToSortByKeys)
+		{
+			std::sort(first, last, [](const EntryPtr& entry1, const EntryPtr& entry2) {
+				return Comp{}(Key::Get(*entry1), Key::Get(*entry2));
+			});
+			return;
+		}
+
+		// Keys are copied next to the entries, so that comparing two of them doesn't have to go through the entries
+		std::vector<std::pair<typename Key::Type, EntryPtr>> keyedEntries;
+		keyedEntries.reserve(last - first);
+		for (Iterator entry = first; entry != last; ++entry)
+		{
+			typename Key::Type key = Key::Get(**entry);
+			keyedEntries.emplace_back(key, std::move(*entry));
+		}
+
+		std::sort(keyedEntries.begin(), keyedEntries.end(), [](const auto& entry1, const auto& entry2) {
+			return Comp{}(entry1.first, entry2.first);
+		});
+
+		for (auto& keyedEntry : keyedEntries)
+		{
+			*first++ = std::move(keyedEntry.second);
+		}
+	}
+	template<typename Key, typename Comp, typename Entry>
+	static void SortEntries(std::vector<std::shared_ptr<Entry>>& entries)
+	{
+		SortEntries<Key, Comp>(entries.begin(), entries.end());
+	}
+	template<typename Key, typename Comp, typename Entry>
+	static void MergeEntries(std::vector<std::shared_ptr<Entry>>& entries, size_t sortedCount)
+	{
+		auto comp = [](const std::shared_ptr<Entry>& entry1, const std::shared_ptr<Entry>& entry2) {
+			return Comp{}(Key::Get(*entry1), Key::Get(*entry2));
+		};
+
+		// The tail is often sorted already (chunks of a parallel sort)
+		auto middle = entries.begin() + sortedCount;
+		if (!std::is_sorted(middle, entries.end(), comp))
+			SortEntries<Key, Comp>(middle, entries.end());
+		std::inplace_merge(entries.begin(), middle, entries.end(), comp);
+	}
+	template<typename Key, typename Comp, typename Entry>
+	static void InsertEntrySorted(std::shared_ptr<Entry> entry, std::vector<std::shared_ptr<Entry>>& entries)
+	{
+		auto place = std::upper_bound(
+			entries.begin(), entries.end(), Key::Get(*entry),
+			[](const typename Key::Type& key, const std::shared_ptr<Entry>& other) {
+				return Comp{}(key, Key::Get(*other));
+			});
+		entries.insert(place, std::move(entry));
+	}
+
+	// What directories use, one shared instance per sorting type (see 'GetSharedSorter')
+	template<typename Key, typename Comp>
+	class SpecializedSorter final : public Sorter
+	{
+	public:
+
+		void SortDirectories(
+			std::vector<std::shared_ptr<Directory>>& directories) override
+		{
+			SortEntries<Key, Comp>(directories);
+		}
+		void SortFiles(
+			std::vector<std::shared_ptr<File>>& files) override
+		{
+			SortEntries<Key, Comp>(files);
+		}
+
+		void InsertDirectorySorted(
+			std::shared_ptr<Directory> directory,
+			std::vector<std::shared_ptr<Directory>>& directories) override
+		{
+			InsertEntrySorted<Key, Comp>(std::move(directory), directories);
+		}
+		void InsertFileSorted(
+			std::shared_ptr<File> file,
+			std::vector<std::shared_ptr<File>>& files) override
+		{
+			InsertEntrySorted<Key, Comp>(std::move(file), files);
+		}
 
-	//constexpr auto fileAlphabeticalCompLH = [](std::shared_ptr<File> file1, std::shared_ptr<File> file2)
-	//{
-	//	return file1->GetFullFileName() < file2->GetFullFileName();
-	//};
-	//constexpr auto fileAlphabeticalCompHL = [](std::shared_ptr<File> file1, std::shared_ptr<File> file2)
-	//{
-	//	return file1->GetFullFileName() > file2->GetFullFileName();
-	//};
+		void MergeDirectories(
+			std::vector<std::shared_ptr<Directory>>& directories,
+			size_t sortedCount) override
+		{
+			MergeEntries<Key, Comp>(directories, sortedCount);
+		}
+		void MergeFiles(
+			std::vector<std::shared_ptr<File>>& files,
+			size_t sortedCount) override
+		{
+			MergeEntries<Key, Comp>(files, sortedCount);
+		}
+	};
+
+	// The sorters don't have any state, so every directory with the same sorting type uses the same one
+	static Sorter* GetSharedSorter(DirEntrySortType sortType)
+	{
+		static SpecializedSorter<NameKey, std::less<>> alphabeticalLowToHigh;
+		static SpecializedSorter<NameKey, std::greater<>> alphabeticalHighToLow;
+		static SpecializedSorter<LastWriteTimeKey, std::less<>> lastWriteTimeLowToHigh;
+		static SpecializedSorter<LastWriteTimeKey, std::greater<>> lastWriteTimeHighToLow;
+
+		switch (sortType)
+		{
+		case DirEntrySortType::ALPHABETICAL_L_TO_H:
+			return &alphabeticalLowToHigh;
+		case DirEntrySortType::ALPHABETICAL_H_TO_L:
+			return &alphabeticalHighToLow;
+		case DirEntrySortType::LAST_WRITE_TIME_L_TO_H:
+			return &lastWriteTimeLowToHigh;
+		case DirEntrySortType::LAST_WRITE_TIME_H_TO_L:
+			return &lastWriteTimeHighToLow;
+		}
+		assert(false && "Unknown sorting type");
+		return &alphabeticalLowToHigh;
+	}
 
 	// File Event
 
@@ -64,28 +237,80 @@ namespace fs
 	// Directory Entry
 
 	DirectoryEntry::DirectoryEntry(const std::filesystem::path& dirEntryPath)
-		: dirEntryPath(dirEntryPath)
+		: name(dirEntryPath.filename().string()),
+		cachedPath(dirEntryPath),
+		cachedPathGeneration(pathGeneration.load(std::memory_order_relaxed))
+	{
+	}
+
+	std::string_view DirectoryEntry::GetNameRef() const
 	{
+		return name.GetName();
 	}
 
 	void DirectoryEntry::Rename(const std::string& newName)
 	{
-		dirEntryPath.replace_filename(newName);
+		impl::InternedName oldName = std::move(name);
+		name = impl::InternedName{ newName };
+
+		if (std::shared_ptr<Directory> parent = GetParentDirectory())
+			parent->OnEntryRenamed(*this, oldName.GetName());
+
 		UpdatePath();
 	}
 
 	const std::filesystem::path& DirectoryEntry::GetPath() const
 	{
-		return dirEntryPath;
+		uint64_t generation = pathGeneration.load(std::memory_order_relaxed);
+		if (cachedPathGeneration.load(std::memory_order_acquire) == generation)
+			return cachedPath;
+
+		// Recursion stops at the first ancestor whose path is still up to date.
+		// The parent's path is taken before locking, so only one mutex is ever held at a time.
+		std::shared_ptr<Directory> parent = GetParentDirectory();
+		const std::filesystem::path* parentPath = parent ? &parent->GetPath() : nullptr;
+
+		std::lock_guard<std::mutex> lock{ GetPathCacheMutex(this) };
+		if (cachedPathGeneration.load(std::memory_order_relaxed) != generation)
+		{
+			// Most of the time the generation was bumped by a change somewhere else and the path is still the same.
+			// It's only overwritten when it really differs, references handed out before stay valid otherwise.
+			if (parentPath)
+			{
+				std::filesystem::path newPath = *parentPath / name.GetName();
+				if (newPath != cachedPath)
+					cachedPath = std::move(newPath);
+			}
+			cachedPathGeneration.store(generation, std::memory_order_release);
+		}
+		return cachedPath;
 	}
 	void DirectoryEntry::UpdatePath()
 	{
-		std::filesystem::path newPath = dirEntryPath.filename();
-		if (!parentDir.expired())
+		std::shared_ptr<Directory> parent = GetParentDirectory();
+		if (parent && IsFile())
 		{
-			newPath = parentDir.lock()->GetPath() / newPath;
+			// Derived by 'GetPath' when it's needed, the generation never matches
+			cachedPath = std::filesystem::path{};
+			cachedPathGeneration.store(0, std::memory_order_relaxed);
+			return;
 		}
-		dirEntryPath = newPath;
+
+		std::filesystem::path newPath = name.GetName();
+		if (parent)
+			newPath = parent->GetPath() / newPath;
+
+		// Whatever is cached inside of this directory was derived from 'cachedPath' (even if it's stale),
+		// so nothing has to be invalidated if it stays the same. That's the case when a tree is being built.
+		if (IsDirectory() && newPath != cachedPath)
+		{
+			const Directory& dir = static_cast<const Directory&>(*this);
+			if (!dir.files.empty() || !dir.directories.empty())
+				pathGeneration.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		cachedPath = std::move(newPath);
+		cachedPathGeneration.store(pathGeneration.load(std::memory_order_relaxed), std::memory_order_relaxed);
 	}
 
 	void DirectoryEntry::SetParentDirectory(std::shared_ptr<Directory> parentDir)
@@ -108,24 +333,15 @@ namespace fs
 
 	bool DirectoryEntry::Exists() const
 	{
-		return std::filesystem::exists(dirEntryPath);
+		return std::filesystem::exists(GetPath());
 	}
 
 	void DirectoryEntry::UpdateStatus(const std::filesystem::path& absPart)
 	{
-		std::filesystem::path absPath = absPart / dirEntryPath;
+		std::filesystem::path absPath = absPart / GetPath();
 		try
 		{
-			std::filesystem::file_time_type time = std::filesystem::last_write_time(absPath);
-			if (time > lastWriteTime)
-			{
-				lastWriteTime = time;
-				modified = true;
-			}
-			else
-			{
-				modified = false;
-			}
+			UpdateStatus(std::filesystem::last_write_time(absPath));
 		}
 		catch (const std::filesystem::filesystem_error& err)
 		{
@@ -133,6 +349,20 @@ namespace fs
 			modified = false;
 		}
 	}
+	void DirectoryEntry::UpdateStatus(std::filesystem::file_time_type currentLastWriteTime)
+	{
+		if (currentLastWriteTime > lastWriteTime)
+		{
+			std::filesystem::file_time_type oldLastWriteTime = lastWriteTime;
+			lastWriteTime = currentLastWriteTime;
+			modified = true;
+			OnLastWriteTimeChanged(oldLastWriteTime);
+		}
+		else
+		{
+			modified = false;
+		}
+	}
 	bool DirectoryEntry::Modified() const
 	{
 		return modified;
@@ -142,6 +372,34 @@ namespace fs
 	{
 		return lastWriteTime;
 	}
+	void DirectoryEntry::SetLastWriteTime(std::filesystem::file_time_type lastWriteTime)
+	{
+		std::filesystem::file_time_type oldLastWriteTime = this->lastWriteTime;
+		this->lastWriteTime = lastWriteTime;
+		modified = false;
+		OnLastWriteTimeChanged(oldLastWriteTime);
+	}
+
+	void DirectoryEntry::OnLastWriteTimeChanged(std::filesystem::file_time_type oldLastWriteTime)
+	{
+		if (lastWriteTime == oldLastWriteTime)
+			return;
+
+		std::shared_ptr<Directory> parent = GetParentDirectory();
+		if (!parent)
+			return;
+
+		parent->OnEntrySortKeyChanged(*this);
+
+		// Last write times of directories aren't part of the summaries
+		if (!IsFile())
+			return;
+
+		uint64_t size = static_cast<const File&>(*this).GetSize();
+		parent->ReplaceInSubtreeSummaries(
+			SubtreeSummary{ 0, 0, size, oldLastWriteTime },
+			SubtreeSummary{ 0, 0, size, lastWriteTime });
+	}
 
 	// Directory
 
@@ -179,24 +437,11 @@ namespace fs
 	{
 		return DirectoryEntryType::DIRECTORY;
 	}
-	std::string Directory::GetName() const
+	std::string_view Directory::GetName() const
 	{
 		return GetDirectoryName();
 	}
 
-	void Directory::UpdatePath()
-	{
-		DirectoryEntry::UpdatePath();
-		for (auto& file : files)
-		{
-			file->UpdatePath();
-		}
-		for (auto& dir : directories)
-		{
-			dir->UpdatePath();
-		}
-	}
-
 	void Directory::AddDirectoryEntry(std::shared_ptr<DirectoryEntry> entry)
 	{
 		if (entry->GetDirectoryEntryType() == DirectoryEntryType::DIRECTORY)
@@ -217,12 +462,16 @@ namespace fs
 		// directories.insert({ dir->GetDirectoryName(), dir });
 
 		InsertDirectorySorted(dir);
+
+		ReplaceInSubtreeSummaries(SubtreeSummary{}, dir->GetSubtreeContribution());
 	}
 	void Directory::AddFile(std::shared_ptr<File> file)
 	{
 		// files.insert({ file->GetFileName(), file });
 
 		InsertFileSorted(file);
+
+		ReplaceInSubtreeSummaries(SubtreeSummary{}, SubtreeSummary{ 1, 0, file->GetSize(), file->GetLastWriteTime() });
 	}
 
 	void Directory::DeleteDirectoryEntry(std::shared_ptr<DirectoryEntry> entry)
@@ -242,107 +491,120 @@ namespace fs
 	}
 	void Directory::DeleteDirectory(const std::string& dirName)
 	{
-		auto nameSearch = [&](const std::shared_ptr<Directory>& dir) {
-			return dirName == dir->GetDirectoryName();
-		};
+		ExpandIfNeeded();
 
-		auto result = std::find_if(std::begin(directories), std::end(directories), nameSearch);
-		if (result == std::end(directories))
+		const std::shared_ptr<Directory>* dir = FindDirectory(dirName);
+		if (!dir)
 			return;
 
-		(*result)->ClearParentDirectory();
-
-		directories.erase(result);
+		DeleteDirectory(*dir);
 	}
 	void Directory::DeleteDirectory(std::shared_ptr<Directory> dir)
 	{
-		directories.erase(
-			std::remove(directories.begin(), directories.end(), dir),
-			directories.end());
+		auto result = std::find(directories.begin(), directories.end(), dir);
+		if (result != directories.end())
+		{
+			EraseDirectory(result, dir->GetNameRef());
+			ReplaceInSubtreeSummaries(dir->GetSubtreeContribution(), SubtreeSummary{});
+		}
 
 		dir->ClearParentDirectory();
 	}
 	void Directory::DeleteFile(const std::string& fileName)
 	{
-		auto nameSearch = [&](const std::shared_ptr<File>& file) {
-			return fileName == file->GetFullFileName();
-		};
+		ExpandIfNeeded();
 
-		auto result = std::find_if(std::begin(files), std::end(files), nameSearch);
-		if (result == std::end(files))
+		const std::shared_ptr<File>* file = FindFile(fileName);
+		if (!file)
 			return;
 
-		(*result)->ClearParentDirectory();
-
-		files.erase(result);
+		DeleteFile(*file);
 	}
 	void Directory::DeleteFile(std::shared_ptr<File> file)
 	{
-		files.erase(
-			std::remove(files.begin(), files.end(), file),
-			files.end());
+		auto result = std::find(files.begin(), files.end(), file);
+		if (result != files.end())
+		{
+			EraseFile(result, file->GetNameRef());
+			ReplaceInSubtreeSummaries(SubtreeSummary{ 1, 0, file->GetSize(), file->GetLastWriteTime() }, SubtreeSummary{});
+		}
 
 		file->ClearParentDirectory();
 	}
 
 	std::shared_ptr<Directory> Directory::GetDirectory(const std::string& dirName)
 	{
-		auto nameSearch = [&](const std::shared_ptr<Directory>& dir) {
-			return dirName == dir->GetDirectoryName();
-		};
-		auto result = std::find_if(std::begin(directories), std::end(directories), nameSearch);
+		ExpandIfNeeded();
 
-		if (result == std::end(directories))
+		const std::shared_ptr<Directory>* result = FindDirectory(dirName);
+		if (!result)
 			return std::shared_ptr<Directory>{};
 		return *result;
 	}
 	std::shared_ptr<File> Directory::GetFile(const std::string& fileName)
 	{
-		auto nameSearch = [&](const std::shared_ptr<File>& file) {
-			return fileName == file->GetFullFileName();
-		};
-		auto result = std::find_if(std::begin(files), std::end(files), nameSearch);
-		
-		if (result == std::end(files))
+		ExpandIfNeeded();
+
+		const std::shared_ptr<File>* result = FindFile(fileName);
+		if (!result)
 			return std::shared_ptr<File>{};
 		return *result;
 	}
 
 	bool Directory::DirectoryExists(const std::string& dirName)
 	{
-		auto nameSearch = [&](std::shared_ptr<Directory> directory) {
-			return dirName == directory->GetDirectoryName();
-		};
-		auto result = std::find_if(std::begin(directories), std::end(directories), nameSearch);
+		ExpandIfNeeded();
 
-		if (result == std::end(directories))
-			return false;
-		return true;
+		return FindDirectory(dirName) != nullptr;
 	}
 	bool Directory::FileExists(const std::string& fileName)
 	{
-		auto nameSearch = [&](std::shared_ptr<File> file) {
-			return fileName == file->GetFullFileName();
-		};
-		auto result = std::find_if(std::begin(files), std::end(files), nameSearch);
+		ExpandIfNeeded();
 
-		if (result == std::end(files))
-			return false;
-		return true;
+		return FindFile(fileName) != nullptr;
 	}
 
 	bool Directory::IsEmpty() const
 	{
+		ExpandIfNeeded();
+
 		return files.size() == 0 && directories.size() == 0;
 	}
 
-	std::string Directory::GetDirectoryName() const
+	std::string_view Directory::GetDirectoryName() const
 	{
-		return dirEntryPath.filename().string();
+		return name.GetName();
+	}
+
+	template <typename Function>
+	void Directory::ForEachDirectoryRecursive(Function function) const
+	{
+		// Pre-order with one explicit stack, subdirectories are pushed in reverse so that the first one is visited first.
+		// Files of a directory come right after it, so every caller copies them in bulk.
+		std::vector<const std::shared_ptr<Directory>*> dirsToVisit;
+		auto pushSubdirs = [&dirsToVisit](const Directory& dir) {
+			dir.ExpandIfNeeded();
+			for (auto subdir = dir.directories.rbegin(); subdir != dir.directories.rend(); ++subdir)
+			{
+				dirsToVisit.push_back(&*subdir);
+			}
+		};
+
+		pushSubdirs(*this);
+		while (!dirsToVisit.empty())
+		{
+			const std::shared_ptr<Directory>& dir = *dirsToVisit.back();
+			dirsToVisit.pop_back();
+
+			pushSubdirs(*dir);
+			function(dir);
+		}
 	}
 
 	std::vector<std::shared_ptr<Directory>> Directory::GetDirectories() const
 	{
+		ExpandIfNeeded();
+
 		std::vector<std::shared_ptr<Directory>> dirs;
 		dirs.insert(dirs.end(), std::begin(directories), std::end(directories));
 		return dirs;
@@ -350,34 +612,35 @@ namespace fs
 	std::vector<std::shared_ptr<Directory>> Directory::GetDirectoriesRecursive() const
 	{
 		std::vector<std::shared_ptr<Directory>> result;
-		for (const auto& dir : directories)
-		{
+		ForEachDirectoryRecursive([&result](const std::shared_ptr<Directory>& dir) {
 			result.push_back(dir);
-			auto dirEntries = dir->GetDirectoriesRecursive();
-			result.insert(result.end(), std::begin(dirEntries), std::end(dirEntries));
-		}
+		});
 		return result;
 	}
 	std::vector<std::shared_ptr<File>> Directory::GetFiles() const
 	{
+		ExpandIfNeeded();
+
 		std::vector<std::shared_ptr<File>> files;
 		files.insert(files.end(), std::begin(this->files), std::end(this->files));
 		return files;
 	}
 	std::vector<std::shared_ptr<File>> Directory::GetFilesRecursive() const
 	{
+		ExpandIfNeeded();
+
 		std::vector<std::shared_ptr<File>> result;
 		result.insert(result.end(), std::begin(files), std::end(files));
-		for (const auto& dir : directories)
-		{
-			auto dirEntries = dir->GetFilesRecursive();
-			result.insert(result.end(), std::begin(dirEntries), std::end(dirEntries));
-		}
+		ForEachDirectoryRecursive([&result](const std::shared_ptr<Directory>& dir) {
+			result.insert(result.end(), std::begin(dir->files), std::end(dir->files));
+		});
 		return result;
 	}
 
 	std::vector<std::shared_ptr<DirectoryEntry>> Directory::GetDirEntries() const
 	{
+		ExpandIfNeeded();
+
 		std::vector<std::shared_ptr<DirectoryEntry>> entries;
 		entries.insert(entries.end(), std::begin(files), std::end(files));
 		entries.insert(entries.end(), std::begin(directories), std::end(directories));
@@ -385,14 +648,14 @@ namespace fs
 	}
 	std::vector<std::shared_ptr<DirectoryEntry>> Directory::GetDirEntriesRecursive() const
 	{
+		ExpandIfNeeded();
+
 		std::vector<std::shared_ptr<DirectoryEntry>> result;
 		result.insert(result.end(), std::begin(files), std::end(files));
-		for (const auto& dir : directories)
-		{
+		ForEachDirectoryRecursive([&result](const std::shared_ptr<Directory>& dir) {
 			result.push_back(dir);
-			auto dirEntries = dir->GetDirEntriesRecursive();
-			result.insert(result.end(), std::begin(dirEntries), std::end(dirEntries));
-		}
+			result.insert(result.end(), std::begin(dir->files), std::end(dir->files));
+		});
 		return result;
 	}
 
@@ -403,27 +666,84 @@ namespace fs
 	void Directory::SetSortingType(DirEntrySortType sortType)
 	{
 		this->sortType = sortType;
-		switch (this->sortType)
-		{
-		case DirEntrySortType::ALPHABETICAL_L_TO_H:
-			sorter = std::make_shared<AlphabeticalSorter>();
-			sorter->SetSortingCompFun(Sorter::SortCompFun::LESS);
-			break;
-		case DirEntrySortType::ALPHABETICAL_H_TO_L:
-			sorter = std::make_shared<AlphabeticalSorter>();
-			sorter->SetSortingCompFun(Sorter::SortCompFun::GREATER);
-			break;
-		case DirEntrySortType::LAST_WRITE_TIME_L_TO_H:
-			sorter = std::make_shared<LastWriteTimeSorter>();
-			sorter->SetSortingCompFun(Sorter::SortCompFun::LESS);
-			break;
-		case DirEntrySortType::LAST_WRITE_TIME_H_TO_L:
-			sorter = std::make_shared<LastWriteTimeSorter>();
-			sorter->SetSortingCompFun(Sorter::SortCompFun::GREATER);
-			break;
-		}
+		sorter = GetSharedSorter(sortType);
 		SortFiles();
 		SortDirectories();
+		sortedFileCount = files.size();
+		sortedDirectoryCount = directories.size();
+	}
+
+	void Directory::BeginBulkAppend()
+	{
+		bulkAppending = true;
+	}
+	void Directory::EndBulkAppend()
+	{
+		if (!bulkAppending)
+			return;
+
+		bulkAppending = false;
+		if (sortedDirectoryCount < directories.size())
+			sorter->MergeDirectories(directories, sortedDirectoryCount);
+		if (sortedFileCount < files.size())
+			sorter->MergeFiles(files, sortedFileCount);
+		sortedDirectoryCount = directories.size();
+		sortedFileCount = files.size();
+
+		IndexNamesIfNeeded();
+
+		for (SortedView* view : views)
+		{
+			view->Sort();
+		}
+	}
+
+	void Directory::SetExpander(DirectoryExpander* expander)
+	{
+		this->expander = expander;
+		expanded = expander == nullptr;
+	}
+	bool Directory::IsExpanded() const
+	{
+		return expanded;
+	}
+	void Directory::Expand()
+	{
+		if (expanded)
+			return;
+
+		// Set first, the expander adds the entries through the regular functions of this class
+		expanded = true;
+		if (!expander->ExpandDirectory(*this))
+			expanded = false;
+	}
+
+	const Directory::Directories& Directory::GetLoadedDirectories() const
+	{
+		return directories;
+	}
+	const Directory::Files& Directory::GetLoadedFiles() const
+	{
+		return files;
+	}
+	std::shared_ptr<Directory> Directory::GetLoadedDirectory(const std::string& dirName) const
+	{
+		const std::shared_ptr<Directory>* result = FindDirectory(dirName);
+		if (!result)
+			return std::shared_ptr<Directory>{};
+		return *result;
+	}
+
+	const SubtreeSummary& Directory::GetSubtreeSummary() const
+	{
+		return summary;
+	}
+
+	void Directory::ExpandIfNeeded() const
+	{
+		// Directories are always created through 'std::make_shared<Directory>', never as const objects
+		if (!expanded)
+			const_cast<Directory*>(this)->Expand();
 	}
 
 	void Directory::SortDirectories()
@@ -437,11 +757,211 @@ namespace fs
 
 	void Directory::InsertDirectorySorted(std::shared_ptr<Directory> dir)
 	{
-		sorter->InsertDirectorySorted(dir, directories);
+		if (directoryIndex.GetSize() > 0)
+			directoryIndex.Insert(dir);
+
+		if (bulkAppending)
+		{
+			directories.push_back(std::move(dir));
+			return;
+		}
+
+		for (SortedView* view : views)
+		{
+			view->OnDirectoryInserted(dir);
+		}
+
+		sorter->InsertDirectorySorted(std::move(dir), directories);
+		sortedDirectoryCount = directories.size();
+		IndexNamesIfNeeded();
 	}
 	void Directory::InsertFileSorted(std::shared_ptr<File> file)
 	{
-		sorter->InsertFileSorted(file, files);
+		if (fileIndex.GetSize() > 0)
+			fileIndex.Insert(file);
+
+		if (bulkAppending)
+		{
+			files.push_back(std::move(file));
+			return;
+		}
+
+		for (SortedView* view : views)
+		{
+			view->OnFileInserted(file);
+		}
+
+		sorter->InsertFileSorted(std::move(file), files);
+		sortedFileCount = files.size();
+		IndexNamesIfNeeded();
+	}
+	void Directory::IndexNamesIfNeeded()
+	{
+		if (directoryIndex.GetSize() == 0 && directories.size() >= nameIndexThreshold)
+		{
+			for (const auto& indexedDir : directories)
+			{
+				directoryIndex.Insert(indexedDir);
+			}
+		}
+		if (fileIndex.GetSize() == 0 && files.size() >= nameIndexThreshold)
+		{
+			for (const auto& indexedFile : files)
+			{
+				fileIndex.Insert(indexedFile);
+			}
+		}
+	}
+
+	void Directory::EraseDirectory(Directories::iterator dir, std::string_view indexedName)
+	{
+		if (directoryIndex.GetSize() > 0)
+		{
+			directoryIndex.Erase(indexedName, dir->get());
+			// Dropped a bit below the threshold, so that a directory around it doesn't rebuild the index all the time
+			if (directories.size() - 1 < nameIndexThreshold / 2)
+				directoryIndex.Clear();
+		}
+
+		for (SortedView* view : views)
+		{
+			view->OnEntryErased(**dir);
+		}
+
+		if (static_cast<size_t>(dir - directories.begin()) < sortedDirectoryCount)
+			sortedDirectoryCount--;
+		directories.erase(dir);
+	}
+	void Directory::EraseFile(Files::iterator file, std::string_view indexedName)
+	{
+		if (fileIndex.GetSize() > 0)
+		{
+			fileIndex.Erase(indexedName, file->get());
+			if (files.size() - 1 < nameIndexThreshold / 2)
+				fileIndex.Clear();
+		}
+
+		for (SortedView* view : views)
+		{
+			view->OnEntryErased(**file);
+		}
+
+		if (static_cast<size_t>(file - files.begin()) < sortedFileCount)
+			sortedFileCount--;
+		files.erase(file);
+	}
+
+	const std::shared_ptr<Directory>* Directory::FindDirectory(std::string_view dirName) const
+	{
+		if (directoryIndex.GetSize() > 0)
+			return directoryIndex.Find(dirName);
+
+		for (const auto& dir : directories)
+		{
+			if (dir->GetNameRef() == dirName)
+				return &dir;
+		}
+		return nullptr;
+	}
+	const std::shared_ptr<File>* Directory::FindFile(std::string_view fileName) const
+	{
+		if (fileIndex.GetSize() > 0)
+			return fileIndex.Find(fileName);
+
+		for (const auto& file : files)
+		{
+			if (file->GetNameRef() == fileName)
+				return &file;
+		}
+		return nullptr;
+	}
+
+	void Directory::OnEntryRenamed(DirectoryEntry& entry, std::string_view oldName)
+	{
+		// Taken out under the old name and put back under the new one, which may also change its place in the order
+		if (entry.IsDirectory())
+		{
+			auto result = std::find_if(directories.begin(), directories.end(),
+				[&entry](const std::shared_ptr<Directory>& dir) { return dir.get() == &entry; });
+			if (result == directories.end())
+				return;
+
+			std::shared_ptr<Directory> dir = *result;
+			EraseDirectory(result, oldName);
+			InsertDirectorySorted(dir);
+		}
+		else
+		{
+			auto result = std::find_if(files.begin(), files.end(),
+				[&entry](const std::shared_ptr<File>& file) { return file.get() == &entry; });
+			if (result == files.end())
+				return;
+
+			std::shared_ptr<File> file = *result;
+			EraseFile(result, oldName);
+			InsertFileSorted(file);
+		}
+	}
+
+	void Directory::OnEntrySortKeyChanged(const DirectoryEntry& entry)
+	{
+		for (SortedView* view : views)
+		{
+			view->OnEntrySortKeyChanged(entry);
+		}
+	}
+
+	void Directory::ReplaceInSubtreeSummaries(SubtreeSummary removed, SubtreeSummary added)
+	{
+		bool countsChanged =
+			removed.fileCount != added.fileCount ||
+			removed.directoryCount != added.directoryCount ||
+			removed.totalSize != added.totalSize;
+
+		// Every level passes the change of its own newest last write time on to its parent
+		Directory* dir = this;
+		std::shared_ptr<Directory> parent;
+		while (dir)
+		{
+			SubtreeSummary& dirSummary = dir->summary;
+			dirSummary.fileCount = dirSummary.fileCount - removed.fileCount + added.fileCount;
+			dirSummary.directoryCount = dirSummary.directoryCount - removed.directoryCount + added.directoryCount;
+			dirSummary.totalSize = dirSummary.totalSize - removed.totalSize + added.totalSize;
+
+			std::filesystem::file_time_type oldNewest = dirSummary.newestLastWriteTime;
+			if (added.newestLastWriteTime > dirSummary.newestLastWriteTime)
+				dirSummary.newestLastWriteTime = added.newestLastWriteTime;
+			else if (removed.newestLastWriteTime == dirSummary.newestLastWriteTime &&
+				added.newestLastWriteTime < removed.newestLastWriteTime)
+				dirSummary.newestLastWriteTime = dir->FindNewestLastWriteTime();
+
+			if (!countsChanged && oldNewest == dirSummary.newestLastWriteTime)
+				break;
+			removed.newestLastWriteTime = oldNewest;
+			added.newestLastWriteTime = dirSummary.newestLastWriteTime;
+
+			parent = dir->GetParentDirectory();
+			dir = parent.get();
+		}
+	}
+	SubtreeSummary Directory::GetSubtreeContribution() const
+	{
+		SubtreeSummary contribution = summary;
+		contribution.directoryCount++;
+		return contribution;
+	}
+	std::filesystem::file_time_type Directory::FindNewestLastWriteTime() const
+	{
+		std::filesystem::file_time_type newest = std::filesystem::file_time_type::min();
+		for (const auto& file : files)
+		{
+			newest = std::max(newest, file->GetLastWriteTime());
+		}
+		for (const auto& dir : directories)
+		{
+			newest = std::max(newest, dir->summary.newestLastWriteTime);
+		}
+		return newest;
 	}
 
 	// File
@@ -463,28 +983,61 @@ namespace fs
 	{
 		return DirectoryEntryType::FILE;
 	}
-	std::string File::GetName() const
+	std::string_view File::GetName() const
 	{
 		return GetFullFileName();
 	}
 
-	void File::UpdatePath()
+	std::string_view File::GetFullFileName() const
 	{
-		DirectoryEntry::UpdatePath();
+		return name.GetName();
 	}
+	std::string_view File::GetFileName() const
+	{
+		return name.GetStem();
+	}
+	std::string_view File::GetFileExtension() const
+	{
+		return name.GetExtension();
+	}
+
+	uint64_t File::GetSize() const
+	{
+		return size;
+	}
+	void File::SetSize(uint64_t size)
+	{
+		uint64_t oldSize = this->size;
+		this->size = size;
+		if (oldSize == size)
+			return;
 
-	std::string File::GetFullFileName() const
+		if (std::shared_ptr<Directory> parent = GetParentDirectory())
+		{
+			parent->ReplaceInSubtreeSummaries(
+				SubtreeSummary{ 0, 0, oldSize, lastWriteTime },
+				SubtreeSummary{ 0, 0, size, lastWriteTime });
+			parent->OnEntrySortKeyChanged(*this);
+		}
+	}
+
+	bool File::HasContentHash() const
+	{
+		return hasContentHash;
+	}
+	uint64_t File::GetContentHash() const
 	{
-		return dirEntryPath.filename().string();
+		return contentHash;
 	}
-	std::string File::GetFileName() const
+	void File::SetContentHash(uint64_t contentHash)
 	{
-		std::filesystem::path fileName{ dirEntryPath };
-		return fileName.filename().replace_extension().string();
+		this->contentHash = contentHash;
+		hasContentHash = true;
 	}
-	std::string File::GetFileExtension() const
+	void File::ClearContentHash()
 	{
-		return dirEntryPath.extension().string();
+		contentHash = 0;
+		hasContentHash = false;
 	}
 
 	// Sorters
@@ -498,94 +1051,108 @@ namespace fs
 		return comp;
 	}
 
+	// A sorter doesn't expose its comparison, so the tail is sorted on its own and two entries are compared
+	// by letting the sorter insert one of them next to the other. An entry is inserted after the ones equal to it,
+	// so it only ends up first if it really goes before the other one.
+	template<typename Entry, typename SortFun, typename InsertFun>
+	static void MergeWithSorter(std::vector<std::shared_ptr<Entry>>& entries, size_t sortedCount, SortFun sort, InsertFun insert)
+	{
+		if (sortedCount == 0)
+		{
+			sort(entries);
+			return;
+		}
+		if (sortedCount >= entries.size())
+			return;
+
+		auto middle = entries.begin() + sortedCount;
+		std::vector<std::shared_ptr<Entry>> tail{ std::make_move_iterator(middle), std::make_move_iterator(entries.end()) };
+		sort(tail);
+		std::move(tail.begin(), tail.end(), middle);
+
+		std::vector<std::shared_ptr<Entry>> pair;
+		pair.reserve(2);
+		std::inplace_merge(entries.begin(), middle, entries.end(), [&](const std::shared_ptr<Entry>& entry1, const std::shared_ptr<Entry>& entry2) {
+			pair.assign(1, entry2);
+			insert(entry1, pair);
+			return pair.front() == entry1;
+		});
+	}
+
+	void Sorter::MergeDirectories(
+		std::vector<std::shared_ptr<Directory>>& directories,
+		size_t sortedCount)
+	{
+		MergeWithSorter(
+			directories, sortedCount,
+			[this](std::vector<std::shared_ptr<Directory>>& entries) { SortDirectories(entries); },
+			[this](const std::shared_ptr<Directory>& entry, std::vector<std::shared_ptr<Directory>>& entries) { InsertDirectorySorted(entry, entries); });
+	}
+	void Sorter::MergeFiles(
+		std::vector<std::shared_ptr<File>>& files,
+		size_t sortedCount)
+	{
+		MergeWithSorter(
+			files, sortedCount,
+			[this](std::vector<std::shared_ptr<File>>& entries) { SortFiles(entries); },
+			[this](const std::shared_ptr<File>& entry, std::vector<std::shared_ptr<File>>& entries) { InsertFileSorted(entry, entries); });
+	}
+
 	// AlphabeticalSorter
 
 	void AlphabeticalSorter::SortDirectories(
 		std::vector<std::shared_ptr<Directory>>& directories)
 	{
-		auto comp = [this](std::shared_ptr<Directory> dir1, std::shared_ptr<Directory> dir2)
-		{
-			if (GetSortingCompFun() == SortCompFun::LESS)
-			{
-				return std::less<std::string>{}(dir1->GetDirectoryName(), dir2->GetDirectoryName());
-			}
-			else if (GetSortingCompFun() == SortCompFun::GREATER)
-			{
-				return std::greater<std::string>{}(dir1->GetDirectoryName(), dir2->GetDirectoryName());
-			}
-			else
-			{
-				return false;
-			}
-		};
-		std::sort(directories.begin(), directories.end(), comp);
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			SortEntries<NameKey, std::less<>>(directories);
+		else
+			SortEntries<NameKey, std::greater<>>(directories);
 	}
 	void AlphabeticalSorter::SortFiles(
 		std::vector<std::shared_ptr<File>>& files)
 	{
-		auto comp = [this](std::shared_ptr<File> file1, std::shared_ptr<File> file2)
-		{
-			if (GetSortingCompFun() == SortCompFun::LESS)
-			{
-				return std::less<std::string>{}(file1->GetFullFileName(), file2->GetFullFileName());
-			}
-			else if (GetSortingCompFun() == SortCompFun::GREATER)
-			{
-				return std::greater<std::string>{}(file1->GetFullFileName(), file2->GetFullFileName());
-			}
-			else
-			{
-				return false;
-			}
-		};
-		std::sort(files.begin(), files.end(), comp);
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			SortEntries<NameKey, std::less<>>(files);
+		else
+			SortEntries<NameKey, std::greater<>>(files);
 	}
 
 	void AlphabeticalSorter::InsertDirectorySorted(
 		std::shared_ptr<Directory> dir,
 		std::vector<std::shared_ptr<Directory>>& directories)
 	{
-		auto place = std::upper_bound(
-			directories.begin(), directories.end(), dir->GetDirectoryName(),
-			[this](const std::string& dirName, std::shared_ptr<Directory> dir)
-			{
-				if (GetSortingCompFun() == SortCompFun::LESS)
-				{
-					return std::less<std::string>{}(dirName, dir->GetDirectoryName());
-				}
-				else if (GetSortingCompFun() == SortCompFun::GREATER)
-				{
-					return std::greater<std::string>{}(dirName, dir->GetDirectoryName());
-				}
-				else
-				{
-					return false;
-				}
-			});
-		directories.insert(place, dir);
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			InsertEntrySorted<NameKey, std::less<>>(std::move(dir), directories);
+		else
+			InsertEntrySorted<NameKey, std::greater<>>(std::move(dir), directories);
 	}
 	void AlphabeticalSorter::InsertFileSorted(
 		std::shared_ptr<File> file,
 		std::vector<std::shared_ptr<File>>& files)
 	{
-		auto place = std::upper_bound(
-			files.begin(), files.end(), file->GetFullFileName(),
-			[this](const std::string& fileName, std::shared_ptr<File> file)
-			{
-				if (GetSortingCompFun() == SortCompFun::LESS)
-				{
-					return std::less<std::string>{}(fileName, file->GetFullFileName());
-				}
-				else if (GetSortingCompFun() == SortCompFun::GREATER)
-				{
-					return std::greater<std::string>{}(fileName, file->GetFullFileName());
-				}
-				else
-				{
-					return false;
-				}
-			});
-		files.insert(place, file);
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			InsertEntrySorted<NameKey, std::less<>>(std::move(file), files);
+		else
+			InsertEntrySorted<NameKey, std::greater<>>(std::move(file), files);
+	}
+
+	void AlphabeticalSorter::MergeDirectories(
+		std::vector<std::shared_ptr<Directory>>& directories,
+		size_t sortedCount)
+	{
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			MergeEntries<NameKey, std::less<>>(directories, sortedCount);
+		else
+			MergeEntries<NameKey, std::greater<>>(directories, sortedCount);
+	}
+	void AlphabeticalSorter::MergeFiles(
+		std::vector<std::shared_ptr<File>>& files,
+		size_t sortedCount)
+	{
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			MergeEntries<NameKey, std::less<>>(files, sortedCount);
+		else
+			MergeEntries<NameKey, std::greater<>>(files, sortedCount);
 	}
 
 	// LastWriteTimeSorter
@@ -593,88 +1160,54 @@ namespace fs
 	void LastWriteTimeSorter::SortDirectories(
 		std::vector<std::shared_ptr<Directory>>& directories)
 	{
-		auto comp = [this](std::shared_ptr<Directory> dir1, std::shared_ptr<Directory> dir2)
-		{
-			if (GetSortingCompFun() == SortCompFun::LESS)
-			{
-				return std::less<std::filesystem::file_time_type>{}(dir1->GetLastWriteTime(), dir2->GetLastWriteTime());
-			}
-			else if (GetSortingCompFun() == SortCompFun::GREATER)
-			{
-				return std::greater<std::filesystem::file_time_type>{}(dir1->GetLastWriteTime(), dir2->GetLastWriteTime());
-			}
-			else
-			{
-				return false;
-			}
-		};
-		std::sort(directories.begin(), directories.end(), comp);
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			SortEntries<LastWriteTimeKey, std::less<>>(directories);
+		else
+			SortEntries<LastWriteTimeKey, std::greater<>>(directories);
 	}
 	void LastWriteTimeSorter::SortFiles(
 		std::vector<std::shared_ptr<File>>& files)
 	{
-		auto comp = [this](std::shared_ptr<File> file1, std::shared_ptr<File> file2)
-		{
-			if (GetSortingCompFun() == SortCompFun::LESS)
-			{
-				return std::less<std::filesystem::file_time_type>{}(file1->GetLastWriteTime(), file2->GetLastWriteTime());
-			}
-			else if (GetSortingCompFun() == SortCompFun::GREATER)
-			{
-				return std::greater<std::filesystem::file_time_type>{}(file1->GetLastWriteTime(), file2->GetLastWriteTime());
-			}
-			else
-			{
-				return false;
-			}
-		};
-		std::sort(files.begin(), files.end(), comp);
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			SortEntries<LastWriteTimeKey, std::less<>>(files);
+		else
+			SortEntries<LastWriteTimeKey, std::greater<>>(files);
 	}
 
 	void LastWriteTimeSorter::InsertDirectorySorted(
 		std::shared_ptr<Directory> directory,
 		std::vector<std::shared_ptr<Directory>>& directories)
 	{
-		auto place = std::upper_bound(
-			directories.begin(), directories.end(), directory->GetLastWriteTime(),
-			[this](const std::filesystem::file_time_type& lastWriteTime, std::shared_ptr<Directory> dir)
-			{
-				if (GetSortingCompFun() == SortCompFun::LESS)
-				{
-					return std::less<std::filesystem::file_time_type>{}(lastWriteTime, dir->GetLastWriteTime());
-				}
-				else if (GetSortingCompFun() == SortCompFun::GREATER)
-				{
-					return std::greater<std::filesystem::file_time_type>{}(lastWriteTime, dir->GetLastWriteTime());
-				}
-				else
-				{
-					return false;
-				}
-			});
-		directories.insert(place, directory);
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			InsertEntrySorted<LastWriteTimeKey, std::less<>>(std::move(directory), directories);
+		else
+			InsertEntrySorted<LastWriteTimeKey, std::greater<>>(std::move(directory), directories);
 	}
 	void LastWriteTimeSorter::InsertFileSorted(
 		std::shared_ptr<File> file,
 		std::vector<std::shared_ptr<File>>& files)
 	{
-		auto place = std::upper_bound(
-			files.begin(), files.end(), file->GetLastWriteTime(),
-			[this](const std::filesystem::file_time_type& lastWriteTime, std::shared_ptr<File> file)
-			{
-				if (GetSortingCompFun() == SortCompFun::LESS)
-				{
-					return std::less<std::filesystem::file_time_type>{}(lastWriteTime, file->GetLastWriteTime());
-				}
-				else if (GetSortingCompFun() == SortCompFun::GREATER)
-				{
-					return std::greater<std::filesystem::file_time_type>{}(lastWriteTime, file->GetLastWriteTime());
-				}
-				else
-				{
-					return false;
-				}
-			});
-		files.insert(place, file);
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			InsertEntrySorted<LastWriteTimeKey, std::less<>>(std::move(file), files);
+		else
+			InsertEntrySorted<LastWriteTimeKey, std::greater<>>(std::move(file), files);
+	}
+	void LastWriteTimeSorter::MergeDirectories(
+		std::vector<std::shared_ptr<Directory>>& directories,
+		size_t sortedCount)
+	{
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			MergeEntries<LastWriteTimeKey, std::less<>>(directories, sortedCount);
+		else
+			MergeEntries<LastWriteTimeKey, std::greater<>>(directories, sortedCount);
+	}
+	void LastWriteTimeSorter::MergeFiles(
+		std::vector<std::shared_ptr<File>>& files,
+		size_t sortedCount)
+	{
+		if (GetSortingCompFun() == SortCompFun::LESS)
+			MergeEntries<LastWriteTimeKey, std::less<>>(files, sortedCount);
+		else
+			MergeEntries<LastWriteTimeKey, std::greater<>>(files, sortedCount);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,415 @@
+#include "../../include/FileSystem/FlatDirectoryTree.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace fs
+{
+	constexpr uint32_t noEntry{ FlatEntryHandle::invalidIndex };
+
+	void FlatDirectoryTree::SetScannerBackend(DirectoryScannerBackend backend)
+	{
+		scanner.SetBackend(backend);
+	}
+	DirectoryScannerBackend FlatDirectoryTree::GetScannerBackend() const
+	{
+		return scanner.GetBackend();
+	}
+
+	void FlatDirectoryTree::BuildRootTree(const std::filesystem::path& rootDirAbsPath)
+	{
+		ClearTree();
+
+		this->rootDirAbsParentPath = rootDirAbsPath.parent_path();
+
+		std::error_code error;
+		uint32_t root = CreateEntry(
+			noEntry,
+			rootDirAbsPath.filename().string(),
+			DirectoryEntryType::DIRECTORY,
+			scanner.GetLastWriteTime(rootDirAbsPath, error));
+
+		// Children of a directory are created together, directories are visited depth-first
+		ScanChildren(root, rootDirAbsPath);
+
+		std::vector<std::pair<uint32_t, std::filesystem::path>> dirsToScan;
+		auto pushSubdirs = [this, &dirsToScan](uint32_t dir, const std::filesystem::path& dirAbsPath) {
+			size_t first = dirsToScan.size();
+			for (uint32_t child = firstChildren[dir]; child != noEntry; child = nextSiblings[child])
+			{
+				if (types[child] == static_cast<uint8_t>(DirectoryEntryType::DIRECTORY))
+					dirsToScan.push_back({ child, dirAbsPath / std::string{ GetName(MakeHandle(child)) } });
+			}
+			// The first subdirectory is scanned first
+			std::reverse(dirsToScan.begin() + first, dirsToScan.end());
+		};
+		pushSubdirs(root, rootDirAbsPath);
+
+		while (!dirsToScan.empty())
+		{
+			auto [dir, dirAbsPath] = std::move(dirsToScan.back());
+			dirsToScan.pop_back();
+
+			try
+			{
+				ScanChildren(dir, dirAbsPath);
+			}
+			catch (const std::filesystem::filesystem_error& err)
+			{
+				std::cerr << err.what() << "\n";
+				continue;
+			}
+			pushSubdirs(dir, dirAbsPath);
+		}
+	}
+	void FlatDirectoryTree::ClearTree()
+	{
+		for (uint32_t generation : generations)
+		{
+			generationBase = std::max(generationBase, generation + 1);
+		}
+
+		// Swapped with empty arrays, so that the memory is actually released
+		nameOffsets = {};
+		nameLengths = {};
+		parents = {};
+		firstChildren = {};
+		nextSiblings = {};
+		types = {};
+		lastWriteTimes = {};
+		generations = {};
+		names = {};
+		freeSlots = {};
+	}
+
+	void FlatDirectoryTree::Compact()
+	{
+		if (types.empty())
+			return;
+
+		// New order: the same one 'BuildRootTree' produces
+		std::vector<uint32_t> order;
+		order.reserve(types.size() - freeSlots.size());
+		order.push_back(0);
+
+		std::vector<uint32_t> dirsToVisit{ 0 };
+		while (!dirsToVisit.empty())
+		{
+			uint32_t dir = dirsToVisit.back();
+			dirsToVisit.pop_back();
+
+			size_t firstSubdir = dirsToVisit.size();
+			for (uint32_t child = firstChildren[dir]; child != noEntry; child = nextSiblings[child])
+			{
+				order.push_back(child);
+				if (types[child] == static_cast<uint8_t>(DirectoryEntryType::DIRECTORY))
+					dirsToVisit.push_back(child);
+			}
+			std::reverse(dirsToVisit.begin() + firstSubdir, dirsToVisit.end());
+		}
+
+		std::vector<uint32_t> newIndices(types.size(), noEntry);
+		for (uint32_t newIndex = 0; newIndex < order.size(); newIndex++)
+		{
+			newIndices[order[newIndex]] = newIndex;
+		}
+		auto remap = [&newIndices](uint32_t index) {
+			return index == noEntry ? noEntry : newIndices[index];
+		};
+
+		FlatDirectoryTree compacted;
+		compacted.rootDirAbsParentPath = rootDirAbsParentPath;
+		compacted.scanner = scanner;
+		compacted.nameOffsets.reserve(order.size());
+		compacted.nameLengths.reserve(order.size());
+		compacted.parents.reserve(order.size());
+		compacted.firstChildren.reserve(order.size());
+		compacted.nextSiblings.reserve(order.size());
+		compacted.types.reserve(order.size());
+		compacted.lastWriteTimes.reserve(order.size());
+		for (uint32_t index : order)
+		{
+			compacted.nameOffsets.push_back(static_cast<uint32_t>(compacted.names.size()));
+			compacted.nameLengths.push_back(nameLengths[index]);
+			compacted.names.append(names, nameOffsets[index], nameLengths[index]);
+			compacted.parents.push_back(remap(parents[index]));
+			compacted.firstChildren.push_back(remap(firstChildren[index]));
+			compacted.nextSiblings.push_back(remap(nextSiblings[index]));
+			compacted.types.push_back(types[index]);
+			compacted.lastWriteTimes.push_back(lastWriteTimes[index]);
+		}
+
+		ClearTree();
+		compacted.generations.assign(order.size(), generationBase);
+		compacted.generationBase = generationBase;
+
+		*this = std::move(compacted);
+	}
+
+	FlatEntryHandle FlatDirectoryTree::AddEntry(
+		FlatEntryHandle parentDir,
+		std::string_view name,
+		DirectoryEntryType type,
+		std::filesystem::file_time_type lastWriteTime)
+	{
+		if (!IsValid(parentDir) || types[parentDir.index] != static_cast<uint8_t>(DirectoryEntryType::DIRECTORY))
+			return FlatEntryHandle{};
+		if (IsValid(GetChild(parentDir, name)))
+			return FlatEntryHandle{};
+
+		uint32_t entry = CreateEntry(parentDir.index, name, type, lastWriteTime);
+		LinkChild(parentDir.index, entry);
+		return MakeHandle(entry);
+	}
+	void FlatDirectoryTree::RemoveEntry(FlatEntryHandle entry)
+	{
+		if (!IsValid(entry) || parents[entry.index] == noEntry)
+			return;
+
+		UnlinkChild(entry.index);
+
+		std::vector<uint32_t> entriesToRemove{ entry.index };
+		while (!entriesToRemove.empty())
+		{
+			uint32_t index = entriesToRemove.back();
+			entriesToRemove.pop_back();
+
+			for (uint32_t child = firstChildren[index]; child != noEntry; child = nextSiblings[child])
+			{
+				entriesToRemove.push_back(child);
+			}
+
+			// The name stays in 'names' until the tree is compacted
+			types[index] = static_cast<uint8_t>(DirectoryEntryType::UNDEFINED);
+			parents[index] = noEntry;
+			firstChildren[index] = noEntry;
+			nextSiblings[index] = noEntry;
+			generations[index]++;
+			freeSlots.push_back(index);
+		}
+	}
+	void FlatDirectoryTree::SetLastWriteTime(FlatEntryHandle entry, std::filesystem::file_time_type lastWriteTime)
+	{
+		if (IsValid(entry))
+			lastWriteTimes[entry.index] = lastWriteTime;
+	}
+
+	bool FlatDirectoryTree::IsValid(FlatEntryHandle entry) const
+	{
+		return entry.index < types.size() &&
+			types[entry.index] != static_cast<uint8_t>(DirectoryEntryType::UNDEFINED) &&
+			generations[entry.index] == entry.generation;
+	}
+
+	FlatEntryHandle FlatDirectoryTree::GetRootDirectory() const
+	{
+		// The root is always the first entry and is never removed
+		if (types.empty())
+			return FlatEntryHandle{};
+		return MakeHandle(0);
+	}
+	FlatEntryHandle FlatDirectoryTree::GetEntry(const std::filesystem::path& relPath) const
+	{
+		FlatEntryHandle entry = GetRootDirectory();
+
+		auto component = relPath.begin();
+		if (!IsValid(entry) || component == relPath.end() || component->string() != GetName(entry))
+			return FlatEntryHandle{};
+
+		for (++component; component != relPath.end() && IsValid(entry); ++component)
+		{
+			entry = GetChild(entry, component->string());
+		}
+		return entry;
+	}
+	FlatEntryHandle FlatDirectoryTree::GetChild(FlatEntryHandle dir, std::string_view name) const
+	{
+		if (!IsValid(dir))
+			return FlatEntryHandle{};
+
+		for (uint32_t child = firstChildren[dir.index]; child != noEntry; child = nextSiblings[child])
+		{
+			std::string_view childName{ names.data() + nameOffsets[child], nameLengths[child] };
+			if (childName == name)
+				return MakeHandle(child);
+			// Children are sorted, so there's no point in looking any further
+			if (childName > name)
+				break;
+		}
+		return FlatEntryHandle{};
+	}
+
+	FlatEntryHandle FlatDirectoryTree::GetParent(FlatEntryHandle entry) const
+	{
+		if (!IsValid(entry))
+			return FlatEntryHandle{};
+		return MakeHandle(parents[entry.index]);
+	}
+	FlatEntryHandle FlatDirectoryTree::GetFirstChild(FlatEntryHandle dir) const
+	{
+		if (!IsValid(dir))
+			return FlatEntryHandle{};
+		return MakeHandle(firstChildren[dir.index]);
+	}
+	FlatEntryHandle FlatDirectoryTree::GetNextSibling(FlatEntryHandle entry) const
+	{
+		if (!IsValid(entry))
+			return FlatEntryHandle{};
+		return MakeHandle(nextSiblings[entry.index]);
+	}
+
+	std::string_view FlatDirectoryTree::GetName(FlatEntryHandle entry) const
+	{
+		return std::string_view{ names.data() + nameOffsets[entry.index], nameLengths[entry.index] };
+	}
+	DirectoryEntryType FlatDirectoryTree::GetType(FlatEntryHandle entry) const
+	{
+		return static_cast<DirectoryEntryType>(types[entry.index]);
+	}
+	std::filesystem::file_time_type FlatDirectoryTree::GetLastWriteTime(FlatEntryHandle entry) const
+	{
+		return lastWriteTimes[entry.index];
+	}
+	std::filesystem::path FlatDirectoryTree::GetPath(FlatEntryHandle entry) const
+	{
+		std::vector<std::string_view> components;
+		for (uint32_t index = entry.index; index != noEntry; index = parents[index])
+		{
+			components.push_back(GetName(MakeHandle(index)));
+		}
+
+		std::filesystem::path path;
+		for (auto component = components.rbegin(); component != components.rend(); ++component)
+		{
+			path /= *component;
+		}
+		return path;
+	}
+
+	void FlatDirectoryTree::ForEachEntry(const std::function<void(FlatEntryHandle)>& function) const
+	{
+		for (uint32_t index = 0; index < types.size(); index++)
+		{
+			if (types[index] != static_cast<uint8_t>(DirectoryEntryType::UNDEFINED))
+				function(MakeHandle(index));
+		}
+	}
+
+	size_t FlatDirectoryTree::GetEntryCount() const
+	{
+		return types.size() - freeSlots.size();
+	}
+	size_t FlatDirectoryTree::GetMemoryUsage() const
+	{
+		return
+			nameOffsets.capacity() * sizeof(uint32_t) +
+			nameLengths.capacity() * sizeof(uint32_t) +
+			parents.capacity() * sizeof(uint32_t) +
+			firstChildren.capacity() * sizeof(uint32_t) +
+			nextSiblings.capacity() * sizeof(uint32_t) +
+			types.capacity() * sizeof(uint8_t) +
+			lastWriteTimes.capacity() * sizeof(std::filesystem::file_time_type) +
+			generations.capacity() * sizeof(uint32_t) +
+			names.capacity() +
+			freeSlots.capacity() * sizeof(uint32_t);
+	}
+
+	uint32_t FlatDirectoryTree::CreateEntry(
+		uint32_t parent,
+		std::string_view name,
+		DirectoryEntryType type,
+		std::filesystem::file_time_type lastWriteTime)
+	{
+		uint32_t nameOffset = static_cast<uint32_t>(names.size());
+		names.append(name);
+
+		if (!freeSlots.empty())
+		{
+			uint32_t index = freeSlots.back();
+			freeSlots.pop_back();
+
+			nameOffsets[index] = nameOffset;
+			nameLengths[index] = static_cast<uint32_t>(name.size());
+			parents[index] = parent;
+			firstChildren[index] = noEntry;
+			nextSiblings[index] = noEntry;
+			types[index] = static_cast<uint8_t>(type);
+			lastWriteTimes[index] = lastWriteTime;
+			return index;
+		}
+
+		nameOffsets.push_back(nameOffset);
+		nameLengths.push_back(static_cast<uint32_t>(name.size()));
+		parents.push_back(parent);
+		firstChildren.push_back(noEntry);
+		nextSiblings.push_back(noEntry);
+		types.push_back(static_cast<uint8_t>(type));
+		lastWriteTimes.push_back(lastWriteTime);
+		generations.push_back(generationBase);
+		return static_cast<uint32_t>(types.size() - 1);
+	}
+	void FlatDirectoryTree::LinkChild(uint32_t parent, uint32_t child)
+	{
+		std::string_view childName = GetName(MakeHandle(child));
+
+		uint32_t previous = noEntry;
+		uint32_t next = firstChildren[parent];
+		while (next != noEntry && GetName(MakeHandle(next)) < childName)
+		{
+			previous = next;
+			next = nextSiblings[next];
+		}
+
+		nextSiblings[child] = next;
+		if (previous == noEntry)
+			firstChildren[parent] = child;
+		else
+			nextSiblings[previous] = child;
+	}
+	void FlatDirectoryTree::UnlinkChild(uint32_t child)
+	{
+		uint32_t parent = parents[child];
+		if (firstChildren[parent] == child)
+		{
+			firstChildren[parent] = nextSiblings[child];
+			return;
+		}
+
+		uint32_t previous = firstChildren[parent];
+		while (nextSiblings[previous] != child)
+		{
+			previous = nextSiblings[previous];
+		}
+		nextSiblings[previous] = nextSiblings[child];
+	}
+
+	void FlatDirectoryTree::ScanChildren(uint32_t dir, const std::filesystem::path& dirAbsPath)
+	{
+		std::vector<ScannedEntry> entries;
+		scanner.ScanDirectory(dirAbsPath, entries);
+
+		std::sort(entries.begin(), entries.end(), [](const ScannedEntry& entry1, const ScannedEntry& entry2) {
+			return entry1.name < entry2.name;
+		});
+
+		// Already sorted, so they're just chained one after another
+		uint32_t previous = noEntry;
+		for (const auto& entry : entries)
+		{
+			uint32_t child = CreateEntry(dir, entry.name, entry.type, entry.lastWriteTime);
+			if (previous == noEntry)
+				firstChildren[dir] = child;
+			else
+				nextSiblings[previous] = child;
+			previous = child;
+		}
+	}
+
+	FlatEntryHandle FlatDirectoryTree::MakeHandle(uint32_t index) const
+	{
+		if (index == noEntry)
+			return FlatEntryHandle{};
+		return FlatEntryHandle{ index, generations[index] };
+	}
+}
\ No newline at end of file
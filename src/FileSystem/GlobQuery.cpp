@@ -0,0 +1,652 @@
+#include "../../include/FileSystem/GlobQuery.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+namespace fs
+{
+	// Replaces the first pair of braces with each of its alternatives in turn, until there are none left
+	static void ExpandBraces(const std::string& pattern, std::vector<std::string>& result)
+	{
+		size_t open = std::string::npos;
+		size_t close = std::string::npos;
+		for (size_t i = 0; i < pattern.size() && open == std::string::npos; i++)
+		{
+			if (pattern[i] != '{')
+				continue;
+
+			size_t depth = 0;
+			for (size_t j = i; j < pattern.size(); j++)
+			{
+				if (pattern[j] == '{')
+				{
+					depth++;
+				}
+				else if (pattern[j] == '}' && --depth == 0)
+				{
+					open = i;
+					close = j;
+					break;
+				}
+			}
+		}
+
+		if (open == std::string::npos)
+		{
+			result.push_back(pattern);
+			return;
+		}
+
+		std::string prefix = pattern.substr(0, open);
+		std::string suffix = pattern.substr(close + 1);
+		size_t depth = 0;
+		size_t alternativeBegin = open + 1;
+		for (size_t i = open + 1; i <= close; i++)
+		{
+			if (pattern[i] == '{')
+			{
+				depth++;
+			}
+			else if (pattern[i] == '}' && depth > 0)
+			{
+				depth--;
+			}
+			else if ((pattern[i] == ',' && depth == 0) || i == close)
+			{
+				ExpandBraces(prefix + pattern.substr(alternativeBegin, i - alternativeBegin) + suffix, result);
+				alternativeBegin = i + 1;
+			}
+		}
+	}
+
+	// GlobQuery
+
+	GlobQuery::GlobQuery(const std::string& pattern)
+	{
+		AddPattern(pattern);
+	}
+	GlobQuery::GlobQuery(const std::vector<std::string>& patterns)
+	{
+		for (const auto& pattern : patterns)
+		{
+			AddPattern(pattern);
+		}
+	}
+
+	bool GlobQuery::Matches(const std::filesystem::path& path, DirectoryEntryType type) const
+	{
+		std::vector<uint32_t> set;
+		std::vector<uint32_t> marks(states.size(), 0);
+		uint32_t mark = 1;
+		for (uint32_t state : startStates)
+		{
+			AddState(state, set, marks, mark);
+		}
+
+		size_t begin = 0;
+		for (auto component = path.begin(); component != path.end(); )
+		{
+			std::string name = component->generic_string();
+			++component;
+			if (name.empty() || name == "/")
+				continue;
+
+			size_t end = set.size();
+			Step(begin, end, name, set, marks, ++mark);
+			begin = end;
+
+			bool last = component == path.end();
+			Verdict verdict = Judge(set.data() + begin, set.size() - begin, !last || type == DirectoryEntryType::DIRECTORY);
+			if (verdict.excluded)
+				return false;
+			if (last)
+				return verdict.matched;
+			if (!verdict.live)
+				return false;
+		}
+		return false;
+	}
+
+	void GlobQuery::AddPattern(const std::string& pattern)
+	{
+		bool exclude = !pattern.empty() && pattern[0] == '!';
+
+		std::vector<std::string> expandedPatterns;
+		ExpandBraces(exclude ? pattern.substr(1) : pattern, expandedPatterns);
+		for (const auto& expandedPattern : expandedPatterns)
+		{
+			CompilePattern(expandedPattern, exclude);
+		}
+	}
+
+	void GlobQuery::CompilePattern(const std::string& pattern, bool exclude)
+	{
+		std::vector<std::string_view> components;
+		std::string_view rest{ pattern };
+		while (!rest.empty())
+		{
+			size_t separator = rest.find('/');
+			std::string_view component = rest.substr(0, separator);
+			if (!component.empty())
+				components.push_back(component);
+			rest = separator == std::string_view::npos ? std::string_view{} : rest.substr(separator + 1);
+		}
+		// Matches nothing
+		if (components.empty())
+			return;
+
+		startStates.push_back(static_cast<uint32_t>(states.size()));
+		for (std::string_view component : components)
+		{
+			if (component == "**")
+			{
+				// Consecutive ones are the same as one
+				if (states.size() > startStates.back() && states.back().type == StateType::ANY_COMPONENTS)
+					continue;
+
+				State state{};
+				state.type = StateType::ANY_COMPONENTS;
+				state.exclude = exclude;
+				states.push_back(std::move(state));
+				continue;
+			}
+			states.push_back(CompileComponent(component, exclude));
+		}
+
+		State accept{};
+		accept.type = StateType::ACCEPT;
+		accept.exclude = exclude;
+		accept.directoriesOnly = pattern.back() == '/';
+		states.push_back(std::move(accept));
+	}
+
+	GlobQuery::State GlobQuery::CompileComponent(std::string_view component, bool exclude)
+	{
+		State state{};
+		state.exclude = exclude;
+
+		auto appendLiteral = [&](char c) {
+			if (state.tokens.empty() || state.tokens.back().type != TokenType::LITERAL)
+				state.tokens.push_back(Token{ TokenType::LITERAL, std::string{}, 0 });
+			state.tokens.back().literal.push_back(c);
+		};
+
+		for (size_t i = 0; i < component.size(); i++)
+		{
+			char c = component[i];
+			if (c == '*')
+			{
+				if (state.tokens.empty() || state.tokens.back().type != TokenType::ANY_CHARS)
+					state.tokens.push_back(Token{ TokenType::ANY_CHARS, std::string{}, 0 });
+			}
+			else if (c == '?')
+			{
+				state.tokens.push_back(Token{ TokenType::ANY_CHAR, std::string{}, 0 });
+			}
+			else if (c == '[')
+			{
+				std::bitset<256> charClass;
+				size_t end = CompileCharClass(component, i, charClass);
+				if (end == std::string_view::npos)
+				{
+					appendLiteral(c);
+					continue;
+				}
+				state.tokens.push_back(Token{ TokenType::CHAR_CLASS, std::string{}, charClasses.size() });
+				charClasses.push_back(charClass);
+				i = end;
+			}
+			else
+			{
+				appendLiteral(c);
+			}
+		}
+
+		if (state.tokens.size() == 1 && state.tokens[0].type == TokenType::LITERAL)
+		{
+			state.type = StateType::LITERAL;
+			state.literal = std::move(state.tokens[0].literal);
+			state.tokens.clear();
+			return state;
+		}
+
+		state.type = StateType::WILDCARD;
+		size_t anyCharsCount = 0;
+		size_t singleCharCount = 0;
+		state.minLength = 0;
+		for (const auto& token : state.tokens)
+		{
+			if (token.type == TokenType::LITERAL)
+				state.minLength += token.literal.size();
+			else if (token.type == TokenType::ANY_CHARS)
+				anyCharsCount++;
+			else
+				singleCharCount++;
+		}
+		state.minLength += singleCharCount;
+
+		if (state.tokens.front().type == TokenType::LITERAL)
+			state.prefix = state.tokens.front().literal;
+		if (state.tokens.back().type == TokenType::LITERAL)
+			state.suffix = state.tokens.back().literal;
+		// The minimum length keeps the prefix and the suffix from overlapping
+		state.prefilterDecides = anyCharsCount == 1 && singleCharCount == 0;
+		return state;
+	}
+
+	size_t GlobQuery::CompileCharClass(std::string_view component, size_t begin, std::bitset<256>& charClass) const
+	{
+		size_t i = begin + 1;
+		bool negate = i < component.size() && (component[i] == '!' || component[i] == '^');
+		if (negate)
+			i++;
+
+		// A ']' right at the start is one of the characters
+		size_t first = i;
+		while (i < component.size() && (component[i] != ']' || i == first))
+		{
+			auto from = static_cast<unsigned char>(component[i]);
+			if (i + 2 < component.size() && component[i + 1] == '-' && component[i + 2] != ']')
+			{
+				auto to = static_cast<unsigned char>(component[i + 2]);
+				for (unsigned c = from; c <= to; c++)
+				{
+					charClass.set(c);
+				}
+				i += 3;
+				continue;
+			}
+			charClass.set(from);
+			i++;
+		}
+
+		if (i >= component.size())
+			return std::string_view::npos;
+		if (negate)
+			charClass.flip();
+		return i;
+	}
+
+	bool GlobQuery::MatchesComponent(const State& state, std::string_view name) const
+	{
+		// The prefix and the suffix are compared with 'memcmp', which the standard libraries vectorize
+		if (name.size() < state.minLength)
+			return false;
+		if (!state.prefix.empty() && std::memcmp(name.data(), state.prefix.data(), state.prefix.size()) != 0)
+			return false;
+		if (!state.suffix.empty()
+			&& std::memcmp(name.data() + name.size() - state.suffix.size(), state.suffix.data(), state.suffix.size()) != 0)
+			return false;
+
+		return state.prefilterDecides || MatchesTokens(state, name);
+	}
+
+	bool GlobQuery::MatchesTokens(const State& state, std::string_view name) const
+	{
+		// Every token but '*' is matched by a fixed number of characters, so backtracking to the last '*'
+		// is enough. Literals that follow a '*' are searched for instead of tried at every position.
+		const std::vector<Token>& tokens = state.tokens;
+		size_t token = 0;
+		size_t position = 0;
+		size_t anyCharsToken = std::string_view::npos;
+		size_t anyCharsEnd = 0;
+
+		auto skipToLiteral = [&](size_t from) {
+			if (token < tokens.size() && tokens[token].type == TokenType::LITERAL)
+				return name.find(tokens[token].literal, from);
+			return from;
+		};
+
+		while (true)
+		{
+			if (token < tokens.size())
+			{
+				const Token& current = tokens[token];
+				if (current.type == TokenType::ANY_CHARS)
+				{
+					token++;
+					if (token == tokens.size())
+						return true;
+
+					anyCharsToken = token - 1;
+					anyCharsEnd = skipToLiteral(position);
+					if (anyCharsEnd == std::string_view::npos)
+						return false;
+					position = anyCharsEnd;
+					continue;
+				}
+
+				size_t rest = name.size() - position;
+				bool matched = false;
+				size_t length = 1;
+				if (current.type == TokenType::LITERAL)
+				{
+					length = current.literal.size();
+					matched = rest >= length && std::memcmp(name.data() + position, current.literal.data(), length) == 0;
+				}
+				else if (current.type == TokenType::ANY_CHAR)
+				{
+					matched = rest > 0;
+				}
+				else
+				{
+					matched = rest > 0 && charClasses[current.charClass][static_cast<unsigned char>(name[position])];
+				}
+
+				if (matched)
+				{
+					position += length;
+					token++;
+					continue;
+				}
+			}
+			else if (position == name.size())
+			{
+				return true;
+			}
+
+			// The last '*' takes one more character
+			if (anyCharsToken == std::string_view::npos || anyCharsEnd >= name.size())
+				return false;
+			token = anyCharsToken + 1;
+			anyCharsEnd = skipToLiteral(anyCharsEnd + 1);
+			if (anyCharsEnd == std::string_view::npos)
+				return false;
+			position = anyCharsEnd;
+		}
+	}
+
+	void GlobQuery::AddState(uint32_t state, std::vector<uint32_t>& set, std::vector<uint32_t>& marks, uint32_t mark) const
+	{
+		// '**' may match no component at all, so whatever follows it is reached right away
+		while (marks[state] != mark)
+		{
+			marks[state] = mark;
+			set.push_back(state);
+			if (states[state].type != StateType::ANY_COMPONENTS)
+				break;
+			state++;
+		}
+	}
+
+	void GlobQuery::Step(
+		size_t begin,
+		size_t end,
+		std::string_view name,
+		std::vector<uint32_t>& set,
+		std::vector<uint32_t>& marks,
+		uint32_t mark) const
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t state = set[i];
+			const State& current = states[state];
+			switch (current.type)
+			{
+			case StateType::LITERAL:
+				if (name == current.literal)
+					AddState(state + 1, set, marks, mark);
+				break;
+			case StateType::WILDCARD:
+				if (MatchesComponent(current, name))
+					AddState(state + 1, set, marks, mark);
+				break;
+			case StateType::ANY_COMPONENTS:
+				AddState(state, set, marks, mark);
+				break;
+			case StateType::ACCEPT:
+				break;
+			}
+		}
+	}
+
+	GlobQuery::Verdict GlobQuery::Judge(const uint32_t* set, size_t count, bool isDirectory) const
+	{
+		Verdict verdict;
+		for (size_t i = 0; i < count; i++)
+		{
+			const State& state = states[set[i]];
+			if (state.type == StateType::ACCEPT)
+			{
+				if (state.directoriesOnly && !isDirectory)
+					continue;
+				if (state.exclude)
+					verdict.excluded = true;
+				else
+					verdict.matched = true;
+			}
+			else if (!state.exclude)
+			{
+				verdict.live = true;
+				if (state.type != StateType::LITERAL)
+					verdict.literalsOnly = false;
+			}
+		}
+		return verdict;
+	}
+
+	// GlobQueryIterator
+
+	GlobQueryIterator::GlobQueryIterator()
+	{
+	}
+	GlobQueryIterator::GlobQueryIterator(const std::shared_ptr<Directory>& rootDirEntry, const GlobQuery& query, bool expand)
+		: query(&query), expand(expand)
+	{
+		stack.reserve(16);
+		marks.assign(query.states.size(), 0);
+
+		// The start states stay at the bottom of 'states' for the whole walk
+		uint32_t startMark = NextMark();
+		for (uint32_t state : query.startStates)
+		{
+			query.AddState(state, states, marks, startMark);
+		}
+
+		if (!Visit(0, states.size(), nullptr, &rootDirEntry))
+			Advance();
+	}
+
+	DirectoryEntry& GlobQueryIterator::operator*() const
+	{
+		if (currentFile)
+			return **currentFile;
+		return **currentDir;
+	}
+	DirectoryEntry* GlobQueryIterator::operator->() const
+	{
+		return &**this;
+	}
+	GlobQueryIterator& GlobQueryIterator::operator++()
+	{
+		Advance();
+		return *this;
+	}
+
+	bool GlobQueryIterator::operator==(const GlobQueryIterator& other) const
+	{
+		return currentFile == other.currentFile && currentDir == other.currentDir;
+	}
+	bool GlobQueryIterator::operator!=(const GlobQueryIterator& other) const
+	{
+		return !(*this == other);
+	}
+
+	const std::shared_ptr<File>& GlobQueryIterator::GetFile() const
+	{
+		assert(currentFile && "The current entry isn't a file");
+		return *currentFile;
+	}
+	const std::shared_ptr<Directory>& GlobQueryIterator::GetDirectory() const
+	{
+		assert(currentDir && "The current entry isn't a directory");
+		return *currentDir;
+	}
+	std::shared_ptr<DirectoryEntry> GlobQueryIterator::GetEntry() const
+	{
+		if (currentFile)
+			return *currentFile;
+		return *currentDir;
+	}
+
+	void GlobQueryIterator::PushLevel(const std::shared_ptr<Directory>& dir, size_t statesBegin, bool literalsOnly)
+	{
+		if (expand)
+			dir->ExpandIfNeeded();
+
+		Level level{ dir.get(), 0, statesBegin, states.size(), candidates.size(), candidates.size(), literalsOnly };
+		if (literalsOnly)
+		{
+			// Files first, like a scan would hand them out
+			for (size_t pass = 0; pass < 2; pass++)
+			{
+				for (size_t i = level.statesBegin; i < level.statesEnd; i++)
+				{
+					const GlobQuery::State& state = query->states[states[i]];
+					if (state.type != GlobQuery::StateType::LITERAL || state.exclude)
+						continue;
+
+					// Patterns sharing a component have states with the same literal
+					bool duplicate = false;
+					for (size_t j = level.statesBegin; j < i && !duplicate; j++)
+					{
+						const GlobQuery::State& other = query->states[states[j]];
+						duplicate = other.type == GlobQuery::StateType::LITERAL && !other.exclude && other.literal == state.literal;
+					}
+					if (duplicate)
+						continue;
+
+					if (pass == 0)
+					{
+						if (const std::shared_ptr<File>* file = dir->FindFile(state.literal))
+							candidates.push_back(Candidate{ file, nullptr });
+					}
+					else if (const std::shared_ptr<Directory>* subdir = dir->FindDirectory(state.literal))
+					{
+						candidates.push_back(Candidate{ nullptr, subdir });
+					}
+				}
+			}
+			level.candidatesEnd = candidates.size();
+		}
+		stack.push_back(level);
+	}
+
+	void GlobQueryIterator::Advance()
+	{
+		if (enterCurrentDir)
+		{
+			enterCurrentDir = false;
+			PushLevel(*currentDir, currentDirStatesBegin, currentDirLiteralsOnly);
+		}
+
+		currentFile = nullptr;
+		currentDir = nullptr;
+
+		while (!stack.empty())
+		{
+			// Copied, 'Visit' may push a level
+			Level level = stack.back();
+			size_t index = stack.back().nextIndex++;
+
+			if (level.lookUp)
+			{
+				if (level.candidatesBegin + index < level.candidatesEnd)
+				{
+					const Candidate& candidate = candidates[level.candidatesBegin + index];
+					if (Visit(level.statesBegin, level.statesEnd, candidate.file, candidate.dir))
+						return;
+					continue;
+				}
+			}
+			else
+			{
+				const Directory::Files& files = level.dir->GetLoadedFiles();
+				const Directory::Directories& dirs = level.dir->GetLoadedDirectories();
+				if (index < files.size())
+				{
+					if (Visit(level.statesBegin, level.statesEnd, &files[index], nullptr))
+						return;
+					continue;
+				}
+				if (index - files.size() < dirs.size())
+				{
+					if (Visit(level.statesBegin, level.statesEnd, nullptr, &dirs[index - files.size()]))
+						return;
+					continue;
+				}
+			}
+
+			states.resize(level.statesBegin);
+			candidates.resize(level.candidatesBegin);
+			stack.pop_back();
+		}
+	}
+
+	bool GlobQueryIterator::Visit(size_t begin, size_t end, const std::shared_ptr<File>* file, const std::shared_ptr<Directory>* dir)
+	{
+		const DirectoryEntry& entry = file ? static_cast<const DirectoryEntry&>(**file) : **dir;
+
+		size_t entryStatesBegin = states.size();
+		query->Step(begin, end, entry.GetNameRef(), states, marks, NextMark());
+		GlobQuery::Verdict verdict = query->Judge(states.data() + entryStatesBegin, states.size() - entryStatesBegin, dir != nullptr);
+
+		if (verdict.excluded)
+		{
+			states.resize(entryStatesBegin);
+			return false;
+		}
+
+		if (dir && verdict.live)
+		{
+			if (verdict.matched)
+			{
+				// Its states are kept until it's entered
+				currentDir = dir;
+				enterCurrentDir = true;
+				currentDirStatesBegin = entryStatesBegin;
+				currentDirLiteralsOnly = verdict.literalsOnly;
+				return true;
+			}
+			PushLevel(*dir, entryStatesBegin, verdict.literalsOnly);
+			return false;
+		}
+
+		states.resize(entryStatesBegin);
+		if (!verdict.matched)
+			return false;
+		currentFile = file;
+		currentDir = dir;
+		return true;
+	}
+
+	uint32_t GlobQueryIterator::NextMark()
+	{
+		if (++mark == 0)
+		{
+			std::fill(marks.begin(), marks.end(), 0);
+			mark = 1;
+		}
+		return mark;
+	}
+
+	// GlobQueryRange
+
+	GlobQueryRange::GlobQueryRange(std::shared_ptr<Directory> rootDir, GlobQuery query, bool expand)
+		: rootDir(std::move(rootDir)), query(std::move(query)), expand(expand)
+	{
+	}
+
+	GlobQueryIterator GlobQueryRange::begin() const
+	{
+		if (!rootDir)
+			return GlobQueryIterator{};
+		return GlobQueryIterator{ rootDir, query, expand };
+	}
+	GlobQueryIterator GlobQueryRange::end() const
+	{
+		return GlobQueryIterator{};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "../../include/FileSystem/InternedName.h"
+
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace impl
+{
+	// Names are spread over this many independently locked parts of the table,
+	// so threads scanning different directories rarely wait for each other
+	constexpr size_t shardCount{ 64 };
+
+	// Open addressing like 'NameIndex': linear probing, deletion shifts the following slots back.
+	// A slot is just a pointer, the hash is kept in the record.
+	class NameTable
+	{
+	public:
+
+		using Record = InternedName::Record;
+
+		static NameTable& Get()
+		{
+			// Never destroyed, so entries that are still alive during static destruction can release their names
+			static NameTable* table = new NameTable;
+			return *table;
+		}
+
+		Record* Acquire(std::string_view name)
+		{
+			size_t fullHash = std::hash<std::string_view>{}(name);
+			uint32_t hash = static_cast<uint32_t>(fullHash ^ (fullHash >> 32));
+
+			Shard& shard = shards[hash % shardCount];
+			std::lock_guard<std::mutex> lock{ shard.mutex };
+
+			if (!shard.slots.empty())
+			{
+				size_t mask = shard.slots.size() - 1;
+				for (size_t slot = GetHomeSlot(hash, mask); shard.slots[slot]; slot = (slot + 1) & mask)
+				{
+					Record* record = shard.slots[slot];
+					if (record->hash == hash && std::string_view{ record->GetChars(), record->size } == name)
+					{
+						record->refCount.fetch_add(1, std::memory_order_relaxed);
+						return record;
+					}
+				}
+			}
+
+			if ((shard.count + 1) * 4 > shard.slots.size() * 3)
+				Grow(shard);
+
+			Record* record = CreateRecord(name, hash);
+			size_t mask = shard.slots.size() - 1;
+			size_t slot = GetHomeSlot(hash, mask);
+			while (shard.slots[slot])
+			{
+				slot = (slot + 1) & mask;
+			}
+			shard.slots[slot] = record;
+			shard.count++;
+			return record;
+		}
+
+		void Release(Record* record)
+		{
+			// Taking a name out of the table and finding it there happen under the same lock,
+			// so a name can't be acquired again while it's being destroyed
+			Shard& shard = shards[record->hash % shardCount];
+			std::lock_guard<std::mutex> lock{ shard.mutex };
+
+			if (record->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				return;
+
+			size_t mask = shard.slots.size() - 1;
+			size_t slot = GetHomeSlot(record->hash, mask);
+			while (shard.slots[slot] != record)
+			{
+				slot = (slot + 1) & mask;
+			}
+			EraseSlot(shard, slot);
+			DestroyRecord(record);
+		}
+
+		size_t GetSize()
+		{
+			size_t size = 0;
+			for (Shard& shard : shards)
+			{
+				std::lock_guard<std::mutex> lock{ shard.mutex };
+				size += shard.count;
+			}
+			return size;
+		}
+
+	private:
+
+		struct Shard
+		{
+			std::mutex mutex;
+			std::vector<Record*> slots;
+			size_t count{ 0 };
+		};
+
+		// The low bits of the hash pick the shard, the ones above them the slot
+		static size_t GetHomeSlot(uint32_t hash, size_t mask)
+		{
+			return (hash / shardCount) & mask;
+		}
+
+		// Same rules as 'std::filesystem::path::extension'
+		static uint32_t FindExtensionOffset(std::string_view name)
+		{
+			size_t dot = name.rfind('.');
+			if (dot == std::string_view::npos || dot == 0 || name == "..")
+				return static_cast<uint32_t>(name.size());
+			return static_cast<uint32_t>(dot);
+		}
+
+		static Record* CreateRecord(std::string_view name, uint32_t hash)
+		{
+			void* memory = ::operator new(sizeof(Record) + name.size());
+			Record* record = new (memory) Record{};
+			record->refCount.store(1, std::memory_order_relaxed);
+			record->hash = hash;
+			record->size = static_cast<uint32_t>(name.size());
+			record->extensionOffset = FindExtensionOffset(name);
+			std::memcpy(reinterpret_cast<char*>(record + 1), name.data(), name.size());
+			return record;
+		}
+		static void DestroyRecord(Record* record)
+		{
+			record->~Record();
+			::operator delete(record);
+		}
+
+		static void Grow(Shard& shard)
+		{
+			std::vector<Record*> oldSlots = std::move(shard.slots);
+			shard.slots = std::vector<Record*>(oldSlots.empty() ? 16 : oldSlots.size() * 2, nullptr);
+
+			size_t mask = shard.slots.size() - 1;
+			for (Record* record : oldSlots)
+			{
+				if (!record)
+					continue;
+
+				size_t slot = GetHomeSlot(record->hash, mask);
+				while (shard.slots[slot])
+				{
+					slot = (slot + 1) & mask;
+				}
+				shard.slots[slot] = record;
+			}
+		}
+
+		static void EraseSlot(Shard& shard, size_t slot)
+		{
+			// Moves back every following record of the cluster that would become unreachable
+			// through the now empty slot
+			size_t mask = shard.slots.size() - 1;
+			size_t next = (slot + 1) & mask;
+			while (shard.slots[next])
+			{
+				size_t home = GetHomeSlot(shard.slots[next]->hash, mask);
+				bool canMove = ((next - home) & mask) >= ((next - slot) & mask);
+				if (canMove)
+				{
+					shard.slots[slot] = shard.slots[next];
+					slot = next;
+				}
+				next = (next + 1) & mask;
+			}
+			shard.slots[slot] = nullptr;
+			shard.count--;
+		}
+
+		Shard shards[shardCount];
+	};
+
+	InternedName::InternedName(std::string_view name)
+		: record(name.empty() ? nullptr : NameTable::Get().Acquire(name))
+	{
+	}
+
+	InternedName::InternedName(const InternedName& other)
+		: record(other.record)
+	{
+		// 'other' holds a reference, so the name can't be released in the meantime
+		if (record)
+			record->refCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	InternedName::InternedName(InternedName&& other) noexcept
+		: record(std::exchange(other.record, nullptr))
+	{
+	}
+	InternedName& InternedName::operator=(const InternedName& other)
+	{
+		InternedName copy{ other };
+		std::swap(record, copy.record);
+		return *this;
+	}
+	InternedName& InternedName::operator=(InternedName&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Release();
+			record = std::exchange(other.record, nullptr);
+		}
+		return *this;
+	}
+	InternedName::~InternedName()
+	{
+		Release();
+	}
+
+	size_t InternedName::GetTableSize()
+	{
+		return NameTable::Get().GetSize();
+	}
+
+	void InternedName::Release()
+	{
+		if (!record)
+			return;
+
+		NameTable::Get().Release(record);
+		record = nullptr;
+	}
+}
\ No newline at end of file
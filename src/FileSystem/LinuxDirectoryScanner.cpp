@@ -0,0 +1,221 @@
+#ifdef __linux__
+
+#include "../../include/FileSystem/LinuxDirectoryScanner.h"
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fs
+{
+	namespace
+	{
+		constexpr size_t DIRENT_BUFFER_SIZE{ 32 * 1024 };
+
+		struct LinuxDirent64
+		{
+			uint64_t d_ino;
+			int64_t d_off;
+			unsigned short d_reclen;
+			unsigned char d_type;
+			char d_name[1];
+		};
+
+		class DirectoryDescriptor
+		{
+		public:
+
+			explicit DirectoryDescriptor(int fd)
+				: fd(fd)
+			{
+			}
+			~DirectoryDescriptor()
+			{
+				if (fd >= 0)
+					close(fd);
+			}
+
+			DirectoryDescriptor(const DirectoryDescriptor&) = delete;
+			DirectoryDescriptor& operator=(const DirectoryDescriptor&) = delete;
+
+			int Get() const
+			{
+				return fd;
+			}
+
+		private:
+
+			int fd{ -1 };
+		};
+
+		std::filesystem::file_time_type::duration CalculateFileClockOffset()
+		{
+			// 'std::filesystem::file_time_type' uses an implementation defined epoch and C++17
+			// has no way of converting to it, so the offset is measured once on an entry that
+			// always exists. The two 'stat' calls make sure the timestamp didn't change in between.
+
+			using namespace std::chrono;
+
+			struct stat before{};
+			struct stat after{};
+			std::filesystem::file_time_type fileTime{};
+
+			for (int attempt = 0; attempt < 8; attempt++)
+			{
+				std::error_code error;
+				if (stat("/", &before) != 0)
+					break;
+				fileTime = std::filesystem::last_write_time("/", error);
+				if (error || stat("/", &after) != 0)
+					break;
+				if (before.st_mtim.tv_sec == after.st_mtim.tv_sec &&
+					before.st_mtim.tv_nsec == after.st_mtim.tv_nsec)
+				{
+					auto sinceUnixEpoch = duration_cast<std::filesystem::file_time_type::duration>(
+						seconds{ after.st_mtim.tv_sec } + nanoseconds{ after.st_mtim.tv_nsec });
+					return fileTime.time_since_epoch() - sinceUnixEpoch;
+				}
+			}
+
+			// Fall back to comparing the clocks directly, which is only off by the time between the two calls
+			auto systemNow = duration_cast<std::filesystem::file_time_type::duration>(
+				system_clock::now().time_since_epoch());
+			return std::filesystem::file_time_type::clock::now().time_since_epoch() - systemNow;
+		}
+
+		DirectoryEntryType ClassifyEntry(unsigned char direntType, const struct stat& status)
+		{
+			switch (direntType)
+			{
+			case DT_REG:
+				return DirectoryEntryType::FILE;
+			case DT_DIR:
+				return DirectoryEntryType::DIRECTORY;
+			case DT_LNK:
+			case DT_UNKNOWN:
+				if (S_ISREG(status.st_mode))
+					return DirectoryEntryType::FILE;
+				if (S_ISDIR(status.st_mode))
+					return DirectoryEntryType::DIRECTORY;
+				return DirectoryEntryType::UNDEFINED;
+			default:
+				return DirectoryEntryType::UNDEFINED;
+			}
+		}
+
+		bool IsDotOrDotDot(const char* name)
+		{
+			return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+		}
+	}
+
+	void LinuxDirectoryScanner::ScanDirectory(
+		const std::filesystem::path& dirAbsPath,
+		std::vector<ScannedEntry>& entries)
+	{
+		DirectoryDescriptor dir{ open(dirAbsPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+		if (dir.Get() < 0)
+		{
+			throw std::filesystem::filesystem_error(
+				"Couldn't open the directory",
+				dirAbsPath,
+				std::error_code{ errno, std::generic_category() });
+		}
+
+		alignas(LinuxDirent64) std::array<char, DIRENT_BUFFER_SIZE> buffer;
+
+		while (true)
+		{
+			long bytesRead = syscall(SYS_getdents64, dir.Get(), buffer.data(), buffer.size());
+			if (bytesRead < 0)
+			{
+				throw std::filesystem::filesystem_error(
+					"Couldn't read the directory",
+					dirAbsPath,
+					std::error_code{ errno, std::generic_category() });
+			}
+			if (bytesRead == 0)
+				break;
+
+			for (long offset = 0; offset < bytesRead;)
+			{
+				const LinuxDirent64* dirent = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+				offset += dirent->d_reclen;
+
+				if (IsDotOrDotDot(dirent->d_name))
+					continue;
+
+				// Follows symlinks, just like 'directory_entry::is_regular_file' and 'last_write_time' do.
+				// Entries that disappeared between 'getdents64' and 'fstatat' are skipped.
+				struct stat status{};
+				if (fstatat(dir.Get(), dirent->d_name, &status, 0) != 0)
+					continue;
+
+				DirectoryEntryType type = ClassifyEntry(dirent->d_type, status);
+				if (type == DirectoryEntryType::UNDEFINED)
+					continue;
+
+				ScannedEntry scannedEntry{};
+				scannedEntry.name = dirent->d_name;
+				scannedEntry.type = type;
+				scannedEntry.lastWriteTime = ToFileTime(status.st_mtim.tv_sec, status.st_mtim.tv_nsec);
+				if (type == DirectoryEntryType::FILE)
+					scannedEntry.size = static_cast<uint64_t>(status.st_size);
+
+				entries.push_back(std::move(scannedEntry));
+			}
+		}
+	}
+
+	std::filesystem::file_time_type LinuxDirectoryScanner::GetLastWriteTime(
+		const std::filesystem::path& absPath,
+		std::error_code& error)
+	{
+		struct stat status{};
+		if (stat(absPath.c_str(), &status) != 0)
+		{
+			error = std::error_code{ errno, std::generic_category() };
+			return std::filesystem::file_time_type{};
+		}
+
+		error.clear();
+		return ToFileTime(status.st_mtim.tv_sec, status.st_mtim.tv_nsec);
+	}
+	EntryStatus LinuxDirectoryScanner::GetStatus(
+		const std::filesystem::path& absPath,
+		std::error_code& error)
+	{
+		struct stat status{};
+		if (stat(absPath.c_str(), &status) != 0)
+		{
+			error = std::error_code{ errno, std::generic_category() };
+			return EntryStatus{};
+		}
+
+		error.clear();
+		EntryStatus entryStatus{};
+		entryStatus.lastWriteTime = ToFileTime(status.st_mtim.tv_sec, status.st_mtim.tv_nsec);
+		if (S_ISREG(status.st_mode))
+			entryStatus.size = static_cast<uint64_t>(status.st_size);
+		return entryStatus;
+	}
+
+	std::filesystem::file_time_type LinuxDirectoryScanner::ToFileTime(time_t seconds, long nanoseconds)
+	{
+		static const std::filesystem::file_time_type::duration fileClockOffset = CalculateFileClockOffset();
+
+		auto sinceUnixEpoch = std::chrono::duration_cast<std::filesystem::file_time_type::duration>(
+			std::chrono::seconds{ seconds } + std::chrono::nanoseconds{ nanoseconds });
+		return std::filesystem::file_time_type{ sinceUnixEpoch + fileClockOffset };
+	}
+}
+
+#endif
\ No newline at end of file
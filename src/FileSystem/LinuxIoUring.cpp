@@ -0,0 +1,232 @@
+#ifdef __linux__
+
+#include "../../include/FileSystem/LinuxIoUring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fs
+{
+	LinuxIoUring::LinuxIoUring(unsigned entries)
+	{
+		io_uring_params params{};
+		ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+		if (ringFd < 0)
+			return;
+
+		sqEntries = params.sq_entries;
+
+		sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+		bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (singleMmap)
+		{
+			sqRingSize = std::max(sqRingSize, cqRingSize);
+			cqRingSize = sqRingSize;
+		}
+
+		sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+		if (sqRing == MAP_FAILED)
+		{
+			sqRing = nullptr;
+			Destroy();
+			return;
+		}
+
+		if (singleMmap)
+		{
+			cqRing = sqRing;
+		}
+		else
+		{
+			cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+			if (cqRing == MAP_FAILED)
+			{
+				cqRing = nullptr;
+				Destroy();
+				return;
+			}
+		}
+
+		sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED)
+		{
+			sqes = nullptr;
+			Destroy();
+			return;
+		}
+
+		char* sq = static_cast<char*>(sqRing);
+		sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+		char* cq = static_cast<char*>(cqRing);
+		cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = cq + params.cq_off.cqes;
+	}
+	LinuxIoUring::~LinuxIoUring()
+	{
+		Destroy();
+	}
+
+	bool LinuxIoUring::IsValid() const
+	{
+		return ringFd >= 0;
+	}
+
+	bool LinuxIoUring::Statx(
+		const std::vector<std::string>& absPaths,
+		std::vector<struct statx>& results,
+		std::vector<int>& errors)
+	{
+		results.assign(absPaths.size(), {});
+		errors.assign(absPaths.size(), 0);
+
+		io_uring_sqe* sqeArray = static_cast<io_uring_sqe*>(sqes);
+		io_uring_cqe* cqeArray = static_cast<io_uring_cqe*>(cqes);
+
+		size_t nextRequest = 0;
+		size_t completed = 0;
+		unsigned inFlight = 0;
+		bool unsupported = false;
+
+		while (completed < absPaths.size())
+		{
+			if (unsupported && inFlight == 0)
+				return false;
+
+			// We're the only producer, so the tail can be read without synchronization.
+			// The kernel is the only consumer, 'sqHead' is only used by it.
+			unsigned tail = *sqTail;
+			unsigned toSubmit = 0;
+			while (!unsupported && nextRequest < absPaths.size() && inFlight + toSubmit < sqEntries)
+			{
+				unsigned index = tail & *sqMask;
+
+				io_uring_sqe& sqe = sqeArray[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = IORING_OP_STATX;
+				sqe.fd = AT_FDCWD;
+				sqe.addr = reinterpret_cast<uint64_t>(absPaths[nextRequest].c_str());
+				sqe.len = STATX_TYPE | STATX_MTIME | STATX_SIZE;
+				sqe.off = reinterpret_cast<uint64_t>(&results[nextRequest]);
+				sqe.statx_flags = 0;
+				sqe.user_data = nextRequest;
+
+				sqArray[index] = index;
+
+				tail++;
+				toSubmit++;
+				nextRequest++;
+			}
+			__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+			inFlight += toSubmit;
+			unsigned notConsumed = toSubmit;
+			if (!SubmitAndWait(notConsumed, 1))
+			{
+				// Entries the kernel didn't take are taken back, the ones it took point into our buffers
+				// and have to complete before they can be freed
+				__atomic_store_n(sqTail, tail - notConsumed, __ATOMIC_RELEASE);
+				WaitForCompletions(inFlight - notConsumed);
+				return false;
+			}
+
+			unsigned head = *cqHead;
+			unsigned cqTailValue = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+			while (head != cqTailValue)
+			{
+				const io_uring_cqe& cqe = cqeArray[head & *cqMask];
+				if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)
+				{
+					// The kernel doesn't know 'IORING_OP_STATX'. Stop submitting, but wait for
+					// the requests that are still in flight since they point into our buffers.
+					unsupported = true;
+				}
+				else if (cqe.res < 0)
+					errors[cqe.user_data] = -cqe.res;
+
+				head++;
+				completed++;
+				inFlight--;
+			}
+			__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		}
+
+		return !unsupported;
+	}
+
+	void LinuxIoUring::Destroy()
+	{
+		if (sqes)
+			munmap(sqes, sqesSize);
+		if (cqRing && cqRing != sqRing)
+			munmap(cqRing, cqRingSize);
+		if (sqRing)
+			munmap(sqRing, sqRingSize);
+		if (ringFd >= 0)
+			close(ringFd);
+
+		sqes = nullptr;
+		cqRing = nullptr;
+		sqRing = nullptr;
+		ringFd = -1;
+	}
+
+	bool LinuxIoUring::SubmitAndWait(unsigned& toSubmit, unsigned minComplete)
+	{
+		// The kernel may consume fewer submission entries than asked for,
+		// keep entering until all of them are taken and at least 'minComplete' requests finished
+		do
+		{
+			long result = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (result < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			toSubmit -= static_cast<unsigned>(result);
+		} while (toSubmit != 0);
+
+		return true;
+	}
+
+	void LinuxIoUring::WaitForCompletions(unsigned count)
+	{
+		unsigned head = *cqHead;
+		while (count != 0)
+		{
+			unsigned cqTailValue = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+			if (head == cqTailValue)
+			{
+				// Completions are posted to the ring whether entering succeeds or not,
+				// so if it keeps failing the ring is just polled
+				long result = syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+				if (result < 0 && errno != EINTR)
+					sched_yield();
+				continue;
+			}
+
+			count -= std::min(count, cqTailValue - head);
+			head = cqTailValue;
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	}
+}
+
+#endif
\ No newline at end of file
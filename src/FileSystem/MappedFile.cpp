@@ -0,0 +1,129 @@
+#include "../../include/FileSystem/MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace impl
+{
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const std::filesystem::path& filePath)
+	{
+		Close();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileW(
+			filePath.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			NULL,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+			NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (view == NULL)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		fileHandle = file;
+		mappingHandle = mapping;
+		data = static_cast<const std::byte*>(view);
+		size = static_cast<size_t>(fileSize.QuadPart);
+#else
+		int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+
+		struct stat status{};
+		if (fstat(fd, &status) != 0 || status.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping stays valid after the descriptor is closed
+		close(fd);
+		if (view == MAP_FAILED)
+			return false;
+
+		data = static_cast<const std::byte*>(view);
+		size = static_cast<size_t>(status.st_size);
+#endif
+
+		return true;
+	}
+	void MappedFile::Close()
+	{
+		if (!data)
+			return;
+
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = nullptr;
+#else
+		munmap(const_cast<std::byte*>(data), size);
+#endif
+
+		data = nullptr;
+		size = 0;
+	}
+
+	bool MappedFile::IsOpen() const
+	{
+		return data != nullptr;
+	}
+
+	const std::byte* MappedFile::GetData() const
+	{
+		return data;
+	}
+	size_t MappedFile::GetSize() const
+	{
+		return size;
+	}
+
+	bool HasFileLayout(size_t fileSize, size_t headerSize, uint64_t recordCount, size_t recordSize, uint64_t tailSize)
+	{
+		if (fileSize < headerSize)
+			return false;
+
+		uint64_t bodySize = fileSize - headerSize;
+		if (recordCount > bodySize / recordSize)
+			return false;
+
+		return tailSize == bodySize - recordCount * recordSize;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,348 @@
+#include "../../include/FileSystem/NameSearchIndex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FS_NAME_SEARCH_SSE2
+#endif
+
+namespace fs
+{
+	// Tombstones are only swept once there are at least this many
+	constexpr size_t minRemovedCountToCompact{ 1024 };
+
+	static char ToLower(char c)
+	{
+		return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+	static void ToLower(std::string_view text, std::string& result)
+	{
+		result.resize(text.size());
+		std::transform(text.begin(), text.end(), result.begin(), [](char c) { return ToLower(c); });
+	}
+
+	// Distinct trigrams of an already lowercased name, sorted
+	static void GetTrigrams(std::string_view loweredName, std::vector<uint32_t>& trigrams)
+	{
+		trigrams.clear();
+		for (size_t i = 0; i + 3 <= loweredName.size(); i++)
+		{
+			trigrams.push_back(
+				static_cast<uint32_t>(static_cast<unsigned char>(loweredName[i])) << 16
+				| static_cast<uint32_t>(static_cast<unsigned char>(loweredName[i + 1])) << 8
+				| static_cast<uint32_t>(static_cast<unsigned char>(loweredName[i + 2])));
+		}
+		std::sort(trigrams.begin(), trigrams.end());
+		trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+	}
+
+	// Both lists are sorted, 'shorter' is expected to be the shorter one
+	static void IntersectSorted(const std::vector<uint32_t>& shorter, const std::vector<uint32_t>& longer, std::vector<uint32_t>& result)
+	{
+		result.clear();
+		if (shorter.empty() || longer.empty())
+			return;
+
+		// Far longer lists are binary searched
+		if (longer.size() / shorter.size() >= 32)
+		{
+			auto from = longer.begin();
+			for (uint32_t id : shorter)
+			{
+				from = std::lower_bound(from, longer.end(), id);
+				if (from == longer.end())
+					break;
+				if (*from == id)
+					result.push_back(id);
+			}
+			return;
+		}
+
+		// Everything before 'position' is smaller than the id being looked for
+		size_t position = 0;
+		for (uint32_t id : shorter)
+		{
+#ifdef FS_NAME_SEARCH_SSE2
+			// Skips 8 ids at a time while they're all smaller. Ids are below 2^31, so the signed comparison works.
+			__m128i key = _mm_set1_epi32(static_cast<int>(id));
+			while (position + 8 <= longer.size())
+			{
+				__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(longer.data() + position));
+				__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(longer.data() + position + 4));
+				int smallerMask = _mm_movemask_epi8(_mm_cmplt_epi32(low, key)) & _mm_movemask_epi8(_mm_cmplt_epi32(high, key));
+				if (smallerMask != 0xFFFF)
+					break;
+				position += 8;
+			}
+#endif
+			while (position < longer.size() && longer[position] < id)
+			{
+				position++;
+			}
+			if (position == longer.size())
+				break;
+			if (longer[position] == id)
+				result.push_back(id);
+		}
+	}
+
+	// NameSearchIndex
+
+	void NameSearchIndex::OnFileAdded(std::shared_ptr<File> file)
+	{
+		Insert(std::move(file));
+	}
+	void NameSearchIndex::OnDirectoryAdded(std::shared_ptr<Directory> dir)
+	{
+		Insert(std::move(dir));
+	}
+
+	void NameSearchIndex::OnFileRemoved(std::shared_ptr<File> file)
+	{
+		Erase(*file);
+	}
+	void NameSearchIndex::OnDirectoryRemoved(std::shared_ptr<Directory> dir)
+	{
+		Erase(*dir);
+	}
+
+	void NameSearchIndex::OnFilePathChanged(std::shared_ptr<File> file, const std::filesystem::path& oldPath)
+	{
+		OnRenamed(std::move(file), oldPath);
+	}
+	void NameSearchIndex::OnDirectoryPathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath)
+	{
+		OnRenamed(std::move(dir), oldPath);
+	}
+	void NameSearchIndex::OnSubtreePathChanged(std::shared_ptr<Directory> dir, const std::filesystem::path& oldPath)
+	{
+		// The names of the entries inside stay the same
+		OnRenamed(std::move(dir), oldPath);
+	}
+
+	void NameSearchIndex::OnFileModified(std::shared_ptr<File>)
+	{
+	}
+	void NameSearchIndex::OnDirectoryModified(std::shared_ptr<Directory>)
+	{
+	}
+
+	void NameSearchIndex::Clear()
+	{
+		entries.clear();
+		ids.clear();
+		removedCount = 0;
+		postings.clear();
+	}
+
+	std::vector<NameSearchResult> NameSearchIndex::Search(
+		std::string_view query,
+		size_t maxResults,
+		NameSearchMode mode) const
+	{
+		std::string loweredQuery;
+		ToLower(query, loweredQuery);
+		if (loweredQuery.empty() || maxResults == 0)
+			return std::vector<NameSearchResult>{};
+
+		std::vector<std::pair<int, uint32_t>> scoredIds;
+		std::string loweredName;
+		auto matchSubstring = [&](uint32_t id) {
+			if (!entries[id])
+				return false;
+
+			ToLower(entries[id]->GetNameRef(), loweredName);
+			size_t position = loweredName.find(loweredQuery);
+			if (position == std::string::npos)
+				return false;
+			scoredIds.push_back({ ScoreSubstringMatch(loweredName, position, loweredQuery.size()), id });
+			return true;
+		};
+
+		std::vector<uint32_t> trigrams;
+		GetTrigrams(loweredQuery, trigrams);
+		if (trigrams.empty())
+		{
+			for (uint32_t id = 0; id < entries.size(); id++)
+			{
+				matchSubstring(id);
+			}
+		}
+		else
+		{
+			// A name containing the query contains all of its trigrams, the rarest ones narrow it down the most
+			std::vector<const std::vector<uint32_t>*> lists;
+			for (uint32_t trigram : trigrams)
+			{
+				auto list = postings.find(trigram);
+				if (list == postings.end())
+				{
+					lists.clear();
+					break;
+				}
+				lists.push_back(&list->second);
+			}
+			std::sort(lists.begin(), lists.end(), [](const auto* list1, const auto* list2) {
+				return list1->size() < list2->size();
+			});
+
+			std::vector<uint32_t> candidates;
+			if (!lists.empty())
+			{
+				candidates = *lists[0];
+				std::vector<uint32_t> intersection;
+				for (size_t i = 1; i < lists.size() && !candidates.empty(); i++)
+				{
+					IntersectSorted(candidates, *lists[i], intersection);
+					candidates.swap(intersection);
+				}
+			}
+
+			std::vector<uint16_t> sharedCounts;
+			if (mode == NameSearchMode::FUZZY)
+				CountSharedTrigrams(trigrams, sharedCounts);
+
+			for (uint32_t id : candidates)
+			{
+				// Already listed, so it's left out of the fuzzy matches
+				if (matchSubstring(id) && !sharedCounts.empty())
+					sharedCounts[id] = 0;
+			}
+
+			if (mode == NameSearchMode::FUZZY)
+			{
+				size_t minSharedCount = (trigrams.size() + 1) / 2;
+				for (uint32_t trigram : trigrams)
+				{
+					auto list = postings.find(trigram);
+					if (list == postings.end())
+						continue;
+
+					for (uint32_t id : list->second)
+					{
+						size_t sharedCount = sharedCounts[id];
+						if (sharedCount < minSharedCount || !entries[id])
+							continue;
+						sharedCounts[id] = 0;
+
+						// Dice coefficient of the two trigram sets, the name's trigrams are estimated from its length
+						size_t nameLength = entries[id]->GetNameRef().size();
+						size_t nameTrigramCount = nameLength > 2 ? nameLength - 2 : 1;
+						double similarity = 2.0 * sharedCount / (trigrams.size() + nameTrigramCount);
+						scoredIds.push_back({ static_cast<int>(std::min(similarity, 1.0) * 999), id });
+					}
+				}
+			}
+		}
+
+		// Older names first among equals
+		auto better = [](const std::pair<int, uint32_t>& result1, const std::pair<int, uint32_t>& result2) {
+			if (result1.first != result2.first)
+				return result1.first > result2.first;
+			return result1.second < result2.second;
+		};
+		size_t resultCount = std::min(maxResults, scoredIds.size());
+		std::partial_sort(scoredIds.begin(), scoredIds.begin() + resultCount, scoredIds.end(), better);
+
+		std::vector<NameSearchResult> results;
+		results.reserve(resultCount);
+		for (size_t i = 0; i < resultCount; i++)
+		{
+			results.push_back(NameSearchResult{ entries[scoredIds[i].second], scoredIds[i].first });
+		}
+		return results;
+	}
+
+	size_t NameSearchIndex::GetNameCount() const
+	{
+		return entries.size() - removedCount;
+	}
+
+	void NameSearchIndex::Insert(std::shared_ptr<DirectoryEntry> entry)
+	{
+		auto id = static_cast<uint32_t>(entries.size());
+		assert(id < (1u << 31) && "Ids have to fit into a signed 32 bit integer");
+		if (!ids.try_emplace(entry.get(), id).second)
+			return;
+
+		std::string loweredName;
+		ToLower(entry->GetNameRef(), loweredName);
+		std::vector<uint32_t> trigrams;
+		GetTrigrams(loweredName, trigrams);
+		for (uint32_t trigram : trigrams)
+		{
+			postings[trigram].push_back(id);
+		}
+		entries.push_back(std::move(entry));
+	}
+	void NameSearchIndex::Erase(const DirectoryEntry& entry)
+	{
+		auto id = ids.find(&entry);
+		if (id == ids.end())
+			return;
+
+		entries[id->second].reset();
+		ids.erase(id);
+		removedCount++;
+		if (removedCount >= minRemovedCountToCompact && removedCount > entries.size() - removedCount)
+			Compact();
+	}
+	void NameSearchIndex::OnRenamed(std::shared_ptr<DirectoryEntry> entry, const std::filesystem::path& oldPath)
+	{
+		if (oldPath.filename().generic_string() == entry->GetNameRef())
+			return;
+
+		// A new id keeps the lists sorted
+		Erase(*entry);
+		Insert(std::move(entry));
+	}
+	void NameSearchIndex::Compact()
+	{
+		std::vector<std::shared_ptr<DirectoryEntry>> liveEntries;
+		liveEntries.reserve(entries.size() - removedCount);
+		for (auto& entry : entries)
+		{
+			if (entry)
+				liveEntries.push_back(std::move(entry));
+		}
+
+		Clear();
+		for (auto& entry : liveEntries)
+		{
+			Insert(std::move(entry));
+		}
+	}
+
+	void NameSearchIndex::CountSharedTrigrams(const std::vector<uint32_t>& trigrams, std::vector<uint16_t>& counts) const
+	{
+		counts.assign(entries.size(), 0);
+		for (uint32_t trigram : trigrams)
+		{
+			auto list = postings.find(trigram);
+			if (list == postings.end())
+				continue;
+
+			for (uint32_t id : list->second)
+			{
+				counts[id]++;
+			}
+		}
+	}
+
+	int NameSearchIndex::ScoreSubstringMatch(std::string_view loweredName, size_t position, size_t queryLength)
+	{
+		// Above every fuzzy match, shorter names first within every kind of match
+		int lengthBonus = 999 - static_cast<int>(std::min<size_t>(loweredName.size(), 999));
+		if (position == 0 && queryLength == loweredName.size())
+			return 4999;
+		if (position == 0)
+			return 3000 + lengthBonus;
+
+		char previous = loweredName[position - 1];
+		bool wordStart = !((previous >= 'a' && previous <= 'z') || (previous >= '0' && previous <= '9'));
+		return (wordStart ? 2000 : 1000) + lengthBonus;
+	}
+}
\ No newline at end of file
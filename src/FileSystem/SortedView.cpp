@@ -0,0 +1,222 @@
+#include "../../include/FileSystem/SortedView.h"
+
+#include <algorithm>
+#include <string_view>
+#include <utility>
+
+namespace fs
+{
+	static bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	// <0, 0 or >0 like 'std::string::compare'. Runs of digits are compared by their values (without parsing them,
+	// so they can be of any length), everything else byte by byte. Names that only differ in leading zeros
+	// ("tex02" and "tex2") are compared as they are.
+	static int CompareNatural(std::string_view name1, std::string_view name2)
+	{
+		size_t i = 0;
+		size_t j = 0;
+		while (i < name1.size() && j < name2.size())
+		{
+			if (!IsDigit(name1[i]) || !IsDigit(name2[j]))
+			{
+				if (name1[i] != name2[j])
+					return static_cast<unsigned char>(name1[i]) < static_cast<unsigned char>(name2[j]) ? -1 : 1;
+				i++;
+				j++;
+				continue;
+			}
+
+			while (i < name1.size() && name1[i] == '0')
+			{
+				i++;
+			}
+			while (j < name2.size() && name2[j] == '0')
+			{
+				j++;
+			}
+
+			size_t numberStart1 = i;
+			size_t numberStart2 = j;
+			while (i < name1.size() && IsDigit(name1[i]))
+			{
+				i++;
+			}
+			while (j < name2.size() && IsDigit(name2[j]))
+			{
+				j++;
+			}
+
+			// More significant digits is a bigger number, the same number of them compares digit by digit
+			size_t length1 = i - numberStart1;
+			size_t length2 = j - numberStart2;
+			if (length1 != length2)
+				return length1 < length2 ? -1 : 1;
+
+			int result = name1.substr(numberStart1, length1).compare(name2.substr(numberStart2, length2));
+			if (result != 0)
+				return result;
+		}
+
+		if (i < name1.size() || j < name2.size())
+			return i < name1.size() ? 1 : -1;
+		return name1.compare(name2);
+	}
+
+	static std::string_view GetExtension(const DirectoryEntry& entry)
+	{
+		return entry.IsFile() ? static_cast<const File&>(entry).GetFileExtension() : std::string_view{};
+	}
+
+	static uint64_t GetSize(const DirectoryEntry& entry)
+	{
+		return entry.IsFile() ? static_cast<const File&>(entry).GetSize() : 0;
+	}
+
+	template <typename Value>
+	static int Compare(const Value& value1, const Value& value2)
+	{
+		return value1 < value2 ? -1 : (value2 < value1 ? 1 : 0);
+	}
+
+	SortedView::SortedView(std::shared_ptr<Directory> dir, std::vector<SortViewOrder> order)
+		: dir(std::move(dir)), order(std::move(order))
+	{
+		this->dir->ExpandIfNeeded();
+		this->dir->views.push_back(this);
+		Sort();
+	}
+	SortedView::~SortedView()
+	{
+		auto& views = dir->views;
+		views.erase(std::find(views.begin(), views.end(), this));
+	}
+
+	std::shared_ptr<Directory> SortedView::GetDirectory() const
+	{
+		return dir;
+	}
+
+	const std::vector<SortViewOrder>& SortedView::GetOrder() const
+	{
+		return order;
+	}
+	void SortedView::SetOrder(std::vector<SortViewOrder> order)
+	{
+		this->order = std::move(order);
+		Sort();
+	}
+
+	const std::vector<std::shared_ptr<Directory>>& SortedView::GetDirectories() const
+	{
+		return directories;
+	}
+	const std::vector<std::shared_ptr<File>>& SortedView::GetFiles() const
+	{
+		return files;
+	}
+
+	void SortedView::OnDirectoryInserted(const std::shared_ptr<Directory>& insertedDir)
+	{
+		auto place = std::upper_bound(directories.begin(), directories.end(), insertedDir,
+			[this](const std::shared_ptr<Directory>& dir1, const std::shared_ptr<Directory>& dir2) {
+				return Precedes(*dir1, *dir2);
+			});
+		directories.insert(place, insertedDir);
+	}
+	void SortedView::OnFileInserted(const std::shared_ptr<File>& insertedFile)
+	{
+		auto place = std::upper_bound(files.begin(), files.end(), insertedFile,
+			[this](const std::shared_ptr<File>& file1, const std::shared_ptr<File>& file2) {
+				return Precedes(*file1, *file2);
+			});
+		files.insert(place, insertedFile);
+	}
+	void SortedView::OnEntryErased(const DirectoryEntry& entry)
+	{
+		// Its keys may have changed since it was inserted, so it's looked for by its address
+		if (entry.IsDirectory())
+		{
+			auto erased = std::find_if(directories.begin(), directories.end(),
+				[&entry](const std::shared_ptr<Directory>& dir) { return dir.get() == &entry; });
+			if (erased != directories.end())
+				directories.erase(erased);
+		}
+		else
+		{
+			auto erased = std::find_if(files.begin(), files.end(),
+				[&entry](const std::shared_ptr<File>& file) { return file.get() == &entry; });
+			if (erased != files.end())
+				files.erase(erased);
+		}
+	}
+	void SortedView::OnEntrySortKeyChanged(const DirectoryEntry& entry)
+	{
+		if (entry.IsDirectory())
+		{
+			auto changed = std::find_if(directories.begin(), directories.end(),
+				[&entry](const std::shared_ptr<Directory>& dir) { return dir.get() == &entry; });
+			if (changed == directories.end())
+				return;
+
+			std::shared_ptr<Directory> changedDir = std::move(*changed);
+			directories.erase(changed);
+			OnDirectoryInserted(changedDir);
+		}
+		else
+		{
+			auto changed = std::find_if(files.begin(), files.end(),
+				[&entry](const std::shared_ptr<File>& file) { return file.get() == &entry; });
+			if (changed == files.end())
+				return;
+
+			std::shared_ptr<File> changedFile = std::move(*changed);
+			files.erase(changed);
+			OnFileInserted(changedFile);
+		}
+	}
+	void SortedView::Sort()
+	{
+		directories = dir->GetLoadedDirectories();
+		files = dir->GetLoadedFiles();
+
+		std::sort(directories.begin(), directories.end(), [this](const std::shared_ptr<Directory>& dir1, const std::shared_ptr<Directory>& dir2) {
+			return Precedes(*dir1, *dir2);
+		});
+		std::sort(files.begin(), files.end(), [this](const std::shared_ptr<File>& file1, const std::shared_ptr<File>& file2) {
+			return Precedes(*file1, *file2);
+		});
+	}
+
+	bool SortedView::Precedes(const DirectoryEntry& entry1, const DirectoryEntry& entry2) const
+	{
+		for (const SortViewOrder& key : order)
+		{
+			int result = 0;
+			switch (key.key)
+			{
+			case SortViewKey::NAME:
+				result = entry1.GetNameRef().compare(entry2.GetNameRef());
+				break;
+			case SortViewKey::NATURAL_NAME:
+				result = CompareNatural(entry1.GetNameRef(), entry2.GetNameRef());
+				break;
+			case SortViewKey::EXTENSION:
+				result = GetExtension(entry1).compare(GetExtension(entry2));
+				break;
+			case SortViewKey::SIZE:
+				result = Compare(GetSize(entry1), GetSize(entry2));
+				break;
+			case SortViewKey::LAST_WRITE_TIME:
+				result = Compare(entry1.GetLastWriteTime(), entry2.GetLastWriteTime());
+				break;
+			}
+
+			if (result != 0)
+				return key.comp == Sorter::SortCompFun::LESS ? result < 0 : result > 0;
+		}
+		return entry1.GetNameRef() < entry2.GetNameRef();
+	}
+}
\ No newline at end of file
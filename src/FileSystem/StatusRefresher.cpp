@@ -0,0 +1,171 @@
+#include "../../include/FileSystem/StatusRefresher.h"
+#include "../../include/FileSystem/TaskPool.h"
+
+#ifdef __linux__
+#include "../../include/FileSystem/LinuxDirectoryScanner.h"
+#include "../../include/FileSystem/LinuxIoUring.h"
+#endif
+
+#include <algorithm>
+#include <string>
+
+namespace fs
+{
+	constexpr unsigned ioUringEntries{ 256 };
+	constexpr size_t entriesPerTask{ 256 };
+
+	StatusRefresher::StatusRefresher()
+	{
+	}
+	StatusRefresher::~StatusRefresher()
+	{
+	}
+
+	void StatusRefresher::SetThreadCount(size_t threadCount)
+	{
+		this->threadCount = threadCount;
+		taskPool.reset();
+	}
+	size_t StatusRefresher::GetThreadCount() const
+	{
+		return threadCount;
+	}
+
+	std::vector<std::error_code> StatusRefresher::RefreshStatus(
+		const std::vector<std::shared_ptr<DirectoryEntry>>& entries,
+		const std::filesystem::path& absPart)
+	{
+		std::vector<std::filesystem::path> absPaths;
+		absPaths.reserve(entries.size());
+		for (const auto& entry : entries)
+		{
+			absPaths.push_back(absPart / entry->GetPath());
+		}
+
+		std::vector<EntryStatus> statuses;
+		std::vector<std::error_code> errors;
+		QueryStatus(absPaths, statuses, errors);
+
+		// Applied on the calling thread, the same entry may appear in the list more than once
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (errors[i])
+			{
+				entries[i]->UpdateStatus(entries[i]->GetLastWriteTime());
+				continue;
+			}
+
+			entries[i]->UpdateStatus(statuses[i].lastWriteTime);
+			if (entries[i]->IsFile())
+				static_cast<File&>(*entries[i]).SetSize(statuses[i].size);
+		}
+
+		return errors;
+	}
+
+	void StatusRefresher::QueryLastWriteTimes(
+		const std::vector<std::filesystem::path>& absPaths,
+		std::vector<std::filesystem::file_time_type>& lastWriteTimes,
+		std::vector<std::error_code>& errors)
+	{
+		std::vector<EntryStatus> statuses;
+		QueryStatus(absPaths, statuses, errors);
+
+		lastWriteTimes.resize(statuses.size());
+		for (size_t i = 0; i < statuses.size(); i++)
+		{
+			lastWriteTimes[i] = statuses[i].lastWriteTime;
+		}
+	}
+	void StatusRefresher::QueryStatus(
+		const std::vector<std::filesystem::path>& absPaths,
+		std::vector<EntryStatus>& statuses,
+		std::vector<std::error_code>& errors)
+	{
+		statuses.assign(absPaths.size(), EntryStatus{});
+		errors.assign(absPaths.size(), std::error_code{});
+
+		if (absPaths.empty())
+			return;
+
+		if (QueryStatusIoUring(absPaths, statuses, errors))
+			return;
+
+		QueryStatusThreadPool(absPaths, statuses, errors);
+	}
+
+	bool StatusRefresher::QueryStatusIoUring(
+		const std::vector<std::filesystem::path>& absPaths,
+		std::vector<EntryStatus>& statuses,
+		std::vector<std::error_code>& errors)
+	{
+#ifdef __linux__
+		if (ioUringUnavailable)
+			return false;
+
+		if (!ioUring)
+		{
+			ioUring = std::make_unique<LinuxIoUring>(ioUringEntries);
+			if (!ioUring->IsValid())
+			{
+				ioUring.reset();
+				ioUringUnavailable = true;
+				return false;
+			}
+		}
+
+		std::vector<std::string> paths;
+		paths.reserve(absPaths.size());
+		for (const auto& absPath : absPaths)
+		{
+			paths.push_back(absPath.string());
+		}
+
+		std::vector<struct statx> results;
+		std::vector<int> statxErrors;
+		if (!ioUring->Statx(paths, results, statxErrors))
+		{
+			ioUring.reset();
+			ioUringUnavailable = true;
+			return false;
+		}
+
+		for (size_t i = 0; i < absPaths.size(); i++)
+		{
+			if (statxErrors[i] != 0)
+			{
+				errors[i] = std::error_code{ statxErrors[i], std::generic_category() };
+				continue;
+			}
+			statuses[i].lastWriteTime = LinuxDirectoryScanner::ToFileTime(
+				results[i].stx_mtime.tv_sec, results[i].stx_mtime.tv_nsec);
+			if (S_ISREG(results[i].stx_mode))
+				statuses[i].size = results[i].stx_size;
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+	void StatusRefresher::QueryStatusThreadPool(
+		const std::vector<std::filesystem::path>& absPaths,
+		std::vector<EntryStatus>& statuses,
+		std::vector<std::error_code>& errors)
+	{
+		if (!taskPool)
+			taskPool = std::make_unique<impl::TaskPool>(threadCount);
+
+		// Every task writes to its own range of 'statuses' and 'errors'
+		for (size_t first = 0; first < absPaths.size(); first += entriesPerTask)
+		{
+			size_t last = std::min(first + entriesPerTask, absPaths.size());
+			taskPool->Submit([this, first, last, &absPaths, &statuses, &errors]() {
+				for (size_t i = first; i < last; i++)
+				{
+					statuses[i] = scanner.GetStatus(absPaths[i], errors[i]);
+				}
+			});
+		}
+		taskPool->Wait();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "../../include/FileSystem/TaskPool.h"
+
+#include <algorithm>
+
+namespace impl
+{
+	namespace
+	{
+		thread_local const TaskPool* currentPool{ nullptr };
+		thread_local size_t currentWorkerIndex{ 0 };
+	}
+
+	TaskPool::TaskPool(size_t threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+		queues.reserve(threadCount);
+		for (size_t i = 0; i < threadCount; i++)
+		{
+			queues.push_back(std::make_unique<WorkerQueue>());
+		}
+
+		workers.reserve(threadCount);
+		for (size_t i = 0; i < threadCount; i++)
+		{
+			workers.emplace_back(&TaskPool::WorkerLoop, this, i);
+		}
+	}
+	TaskPool::~TaskPool()
+	{
+		{
+			std::lock_guard lock{ stateMutex };
+			exit = true;
+		}
+		taskAvailable.notify_all();
+
+		for (auto& worker : workers)
+		{
+			if (worker.joinable())
+				worker.join();
+		}
+	}
+
+	void TaskPool::Submit(Task task)
+	{
+		size_t queueIndex = GetCurrentWorkerIndex();
+		if (queueIndex == queues.size())
+			queueIndex = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+		pendingTasks.fetch_add(1, std::memory_order_relaxed);
+		{
+			// Counted before it's pushed, so a worker that takes it right away can't decrement
+			// the count below zero. Taking the lock here makes sure a worker that's about to go to sleep
+			// can't miss the notification below.
+			std::lock_guard lock{ stateMutex };
+			queuedTasks.fetch_add(1, std::memory_order_relaxed);
+		}
+		{
+			std::lock_guard lock{ queues[queueIndex]->mutex };
+			queues[queueIndex]->tasks.push_back(std::move(task));
+		}
+		taskAvailable.notify_one();
+	}
+
+	void TaskPool::Wait()
+	{
+		std::unique_lock lock{ stateMutex };
+		allTasksDone.wait(lock, [this]() {
+			return pendingTasks.load() == 0;
+		});
+
+		if (firstException)
+		{
+			std::exception_ptr exception = firstException;
+			firstException = nullptr;
+			std::rethrow_exception(exception);
+		}
+	}
+
+	size_t TaskPool::GetThreadCount() const
+	{
+		return workers.size();
+	}
+
+	size_t TaskPool::GetCurrentWorkerIndex() const
+	{
+		if (currentPool == this)
+			return currentWorkerIndex;
+		return queues.size();
+	}
+
+	void TaskPool::WorkerLoop(size_t workerIndex)
+	{
+		currentPool = this;
+		currentWorkerIndex = workerIndex;
+
+		Task task;
+		while (true)
+		{
+			if (PopTask(workerIndex, task) || StealTask(workerIndex, task))
+			{
+				RunTask(task);
+				continue;
+			}
+
+			std::unique_lock lock{ stateMutex };
+			taskAvailable.wait(lock, [this]() {
+				return exit || queuedTasks.load() != 0;
+			});
+			if (exit && queuedTasks.load() == 0)
+				break;
+		}
+	}
+
+	bool TaskPool::PopTask(size_t workerIndex, Task& task)
+	{
+		WorkerQueue& queue = *queues[workerIndex];
+		std::lock_guard lock{ queue.mutex };
+		if (queue.tasks.empty())
+			return false;
+
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+		queuedTasks.fetch_sub(1);
+		return true;
+	}
+	bool TaskPool::StealTask(size_t workerIndex, Task& task)
+	{
+		for (size_t offset = 1; offset < queues.size(); offset++)
+		{
+			WorkerQueue& victim = *queues[(workerIndex + offset) % queues.size()];
+			std::lock_guard lock{ victim.mutex };
+			if (victim.tasks.empty())
+				continue;
+
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			queuedTasks.fetch_sub(1);
+			return true;
+		}
+		return false;
+	}
+
+	void TaskPool::RunTask(Task& task)
+	{
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			std::lock_guard lock{ stateMutex };
+			if (!firstException)
+				firstException = std::current_exception();
+		}
+		task = nullptr;
+
+		if (pendingTasks.fetch_sub(1) == 1)
+		{
+			std::lock_guard lock{ stateMutex };
+			allTasksDone.notify_all();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "../../include/FileSystem/TreeVersion.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace fs
+{
+	// TreeVersionFile
+
+	TreeVersionFile::TreeVersionFile(const File& file)
+		: name(file.GetNameRef()), lastWriteTime(file.GetLastWriteTime())
+	{
+	}
+
+	std::string_view TreeVersionFile::GetName() const
+	{
+		return name.GetName();
+	}
+
+	std::filesystem::file_time_type TreeVersionFile::GetLastWriteTime() const
+	{
+		return lastWriteTime;
+	}
+
+	// TreeVersionDirectory
+
+	TreeVersionDirectory::TreeVersionDirectory(const Directory& dir, Files files, Directories directories)
+		: name(dir.GetNameRef()),
+		lastWriteTime(dir.GetLastWriteTime()),
+		sortType(dir.GetSortingType()),
+		expanded(dir.IsExpanded()),
+		files(std::move(files)),
+		directories(std::move(directories))
+	{
+	}
+
+	std::string_view TreeVersionDirectory::GetName() const
+	{
+		return name.GetName();
+	}
+
+	std::filesystem::file_time_type TreeVersionDirectory::GetLastWriteTime() const
+	{
+		return lastWriteTime;
+	}
+	DirEntrySortType TreeVersionDirectory::GetSortingType() const
+	{
+		return sortType;
+	}
+	bool TreeVersionDirectory::IsExpanded() const
+	{
+		return expanded;
+	}
+
+	std::shared_ptr<const TreeVersionDirectory> TreeVersionDirectory::GetDirectory(const std::string& dirName) const
+	{
+		auto nameSearch = [&](const std::shared_ptr<const TreeVersionDirectory>& dir) {
+			return dirName == dir->GetName();
+		};
+		auto result = std::find_if(std::begin(directories), std::end(directories), nameSearch);
+
+		if (result == std::end(directories))
+			return std::shared_ptr<const TreeVersionDirectory>{};
+		return *result;
+	}
+	std::shared_ptr<const TreeVersionFile> TreeVersionDirectory::GetFile(const std::string& fileName) const
+	{
+		auto nameSearch = [&](const std::shared_ptr<const TreeVersionFile>& file) {
+			return fileName == file->GetName();
+		};
+		auto result = std::find_if(std::begin(files), std::end(files), nameSearch);
+
+		if (result == std::end(files))
+			return std::shared_ptr<const TreeVersionFile>{};
+		return *result;
+	}
+
+	const TreeVersionDirectory::Directories& TreeVersionDirectory::GetDirectories() const
+	{
+		return directories;
+	}
+	const TreeVersionDirectory::Files& TreeVersionDirectory::GetFiles() const
+	{
+		return files;
+	}
+
+	TreeVersionDirectory::Directories TreeVersionDirectory::GetDirectoriesRecursive() const
+	{
+		// Pre-order, subdirectories are pushed in reverse so that the first one is visited first
+		Directories result;
+		std::vector<const std::shared_ptr<const TreeVersionDirectory>*> dirsToVisit;
+		for (auto subdir = directories.rbegin(); subdir != directories.rend(); ++subdir)
+		{
+			dirsToVisit.push_back(&*subdir);
+		}
+		while (!dirsToVisit.empty())
+		{
+			const std::shared_ptr<const TreeVersionDirectory>& dir = *dirsToVisit.back();
+			dirsToVisit.pop_back();
+
+			result.push_back(dir);
+			for (auto subdir = dir->directories.rbegin(); subdir != dir->directories.rend(); ++subdir)
+			{
+				dirsToVisit.push_back(&*subdir);
+			}
+		}
+		return result;
+	}
+	TreeVersionDirectory::Files TreeVersionDirectory::GetFilesRecursive() const
+	{
+		Files result;
+		std::vector<const TreeVersionDirectory*> dirsToVisit{ this };
+		while (!dirsToVisit.empty())
+		{
+			const TreeVersionDirectory* dir = dirsToVisit.back();
+			dirsToVisit.pop_back();
+
+			result.insert(result.end(), std::begin(dir->files), std::end(dir->files));
+			for (auto subdir = dir->directories.rbegin(); subdir != dir->directories.rend(); ++subdir)
+			{
+				dirsToVisit.push_back(subdir->get());
+			}
+		}
+		return result;
+	}
+
+	// TreeVersion
+
+	TreeVersion::TreeVersion(std::shared_ptr<const TreeVersionDirectory> rootDir, uint64_t versionIndex)
+		: rootDir(std::move(rootDir)), versionIndex(versionIndex)
+	{
+	}
+
+	std::shared_ptr<const TreeVersionDirectory> TreeVersion::GetRootDirectory() const
+	{
+		return rootDir;
+	}
+
+	std::shared_ptr<const TreeVersionDirectory> TreeVersion::GetDirectory(const std::filesystem::path& dirPath) const
+	{
+		auto component = dirPath.begin();
+		if (!rootDir || component == dirPath.end() || component->generic_string() != rootDir->GetName())
+			return std::shared_ptr<const TreeVersionDirectory>{};
+
+		std::shared_ptr<const TreeVersionDirectory> dir = rootDir;
+		for (++component; component != dirPath.end() && dir; ++component)
+		{
+			dir = dir->GetDirectory(component->generic_string());
+		}
+		return dir;
+	}
+
+	uint64_t TreeVersion::GetVersionIndex() const
+	{
+		return versionIndex;
+	}
+}
\ No newline at end of file